@@ -6,6 +6,8 @@
 
 QT       += core gui
 QT       += serialport
+QT       += concurrent
+QT       += svg
 CONFIG += c++11
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets printsupport
@@ -16,11 +18,66 @@ TEMPLATE = app
 SOURCES += main.cpp\
         mainwindow.cpp \
         qcustomplot/qcustomplot.cpp \
-        helpwindow.cpp
+        helpwindow.cpp \
+        spectrum.cpp \
+        waterfallmap.cpp \
+        waterfallwindow.cpp \
+        persistence.cpp \
+        frameparser.cpp \
+        filterchain.cpp \
+        mathchannel.cpp \
+        slidingminmax.cpp \
+        channelstore.cpp \
+        channelview.cpp \
+        columncodec.cpp \
+        disktier.cpp \
+        csvimporter.cpp \
+        ingestpipeline.cpp \
+        csvrecorder.cpp \
+        headlesscapture.cpp \
+        batchrenderer.cpp \
+        plotexport.cpp \
+        traceraster.cpp \
+        tracecompositor.cpp \
+        tracereducer.cpp \
+        framerenderer.cpp \
+        tracepresenter.cpp \
+        bufferpool.cpp \
+        serialreader.cpp \
+        overloadguard.cpp \
+        flightrecorder.cpp
 
 HEADERS  += mainwindow.hpp \
         qcustomplot/qcustomplot.h \
-        helpwindow.hpp
+        helpwindow.hpp \
+        spectrum.hpp \
+        waterfallmap.hpp \
+        waterfallwindow.hpp \
+        persistence.hpp \
+        samplebatch.hpp \
+        frameparser.hpp \
+        filterchain.hpp \
+        mathchannel.hpp \
+        slidingminmax.hpp \
+        channelstore.hpp \
+        channelview.hpp \
+        columncodec.hpp \
+        disktier.hpp \
+        csvimporter.hpp \
+        ingestpipeline.hpp \
+        csvrecorder.hpp \
+        headlesscapture.hpp \
+        batchrenderer.hpp \
+        plotexport.hpp \
+        traceraster.hpp \
+        tracecompositor.hpp \
+        tracereducer.hpp \
+        framerenderer.hpp \
+        tracepresenter.hpp \
+        bufferpool.hpp \
+        serialreader.hpp \
+        overloadguard.hpp \
+        flightrecorder.hpp
 
 
 FORMS    += mainwindow.ui \
@@ -0,0 +1,376 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "batchrenderer.hpp"
+#include "channelview.hpp"
+#include "csvimporter.hpp"
+#include "csvrecorder.hpp"
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QThread>
+#include <QFileInfo>
+#include <QSvgGenerator>
+#include <QtConcurrent>
+#include <QtEndian>
+
+/* Same palette as the plot window */
+static const char *traceColors[] = { "#fb4934", "#b8bb26", "#fabd2f", "#83a598", "#d3869b", "#8ec07c", "#fe8019",
+                                     "#cc241d", "#98971a", "#d79921", "#458588", "#b16286", "#689d6a", "#d65d0e" };
+
+/**
+ * @brief Constructor
+ */
+BatchRenderer::BatchRenderer()
+{
+    plot.setNotAntialiasedElements (QCP::aeAll);
+    plot.legend->setVisible (true);
+    plot.axisRect()->insetLayout()->setInsetAlignment (0, Qt::AlignTop|Qt::AlignRight);
+    plot.plotLayout()->insertRow (0);
+    title = new QCPTextElement (&plot);
+    plot.plotLayout()->addElement (0, 0, title);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Check the raw command line before any application object exists
+ * @param argc
+ * @param argv
+ * @return
+ */
+bool BatchRenderer::requested (int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+      {
+        if (qstrcmp (argv[i], "--render") == 0)
+          {
+            return true;
+          }
+      }
+    return false;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse the options, load the recordings in parallel and render each one
+ * @param arguments QApplication::arguments()
+ * @return 0 if every recording was rendered
+ */
+int BatchRenderer::run (const QStringList &arguments)
+{
+    QTextStream err (stderr);
+    QCommandLineParser options;
+    options.setApplicationDescription ("Render CSV recordings to image files without the plot window.");
+    options.addHelpOption();
+    options.addPositionalArgument ("files", "CSV recordings to render: .csv, " PACKED_SUFFIX " or a segment " SEGMENT_INDEX_SUFFIX ".", "files...");
+    options.addOption (QCommandLineOption ("render", "Render recordings and exit."));
+    options.addOption (QCommandLineOption (QStringList() << "c" << "channels", "Comma separated channel indexes or header names (default: all).", "list"));
+    options.addOption (QCommandLineOption ("from", "First sample to show (default: first recorded).", "sample"));
+    options.addOption (QCommandLineOption ("to", "Last sample to show (default: last recorded).", "sample"));
+    options.addOption (QCommandLineOption (QStringList() << "f" << "format", "png, svg or pdf (default png).", "format", "png"));
+    options.addOption (QCommandLineOption (QStringList() << "s" << "size", "Image size (default 1920x1080).", "WxH", "1920x1080"));
+    options.addOption (QCommandLineOption (QStringList() << "o" << "output", "Directory for the images (default: next to each recording).", "dir"));
+    options.addOption (QCommandLineOption (QStringList() << "j" << "jobs", "Recordings loaded at once (default: one per core).", "count",
+                                           QString::number (QThread::idealThreadCount())));
+    if (!options.parse (arguments))
+      {
+        err << options.errorText() << endl;
+        return 2;
+      }
+    if (options.isSet ("help"))
+      {
+        QTextStream (stdout) << options.helpText();
+        return 0;
+      }
+
+    const QStringList files = options.positionalArguments();
+    format = options.value ("format").toLower();
+    const QStringList dimensions = options.value ("size").split ('x');
+    size = dimensions.size() == 2 ? QSize (dimensions[0].toInt(), dimensions[1].toInt()) : QSize();
+    if (files.isEmpty() || (format != "png" && format != "svg" && format != "pdf") || size.isEmpty())
+      {
+        err << options.helpText();
+        return 2;
+      }
+    if (options.isSet ("channels"))
+      {
+        channelSpec = options.value ("channels").split (',', QString::SkipEmptyParts);
+      }
+    hasFrom = options.isSet ("from");
+    hasTo = options.isSet ("to");
+    from = options.value ("from").toDouble();
+    to = options.value ("to").toDouble();
+    outputDir = options.value ("output");
+
+    /* Loading runs ahead on the pool while finished recordings are rendered */
+    QThreadPool pool;
+    pool.setMaxThreadCount (qMax (1, options.value ("jobs").toInt()));
+    QList<Recording*> recordings;
+    QList<QFuture<void> > loading;
+    foreach (const QString &fileName, files)
+      {
+        Recording *recording = new Recording;
+        recording->fileName = fileName;
+        recordings.append (recording);
+        loading.append (QtConcurrent::run (&pool, load, recording));
+      }
+
+    int failed = 0;
+    for (int i = 0; i < recordings.size(); i++)
+      {
+        loading[i].waitForFinished();
+        if (!recordings[i]->loaded)
+          {
+            err << "Cannot read " << recordings[i]->fileName << endl;
+            failed++;
+          }
+        else if (!render (recordings[i]))
+          {
+            failed++;
+          }
+        delete recordings[i];                                                             // Free it while the others load
+      }
+    return failed > 0 ? 1 : 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse a whole recording into its store, on a pool thread
+ *
+ * Frames are keyed by their line number, as when shown in the window. A
+ * segment index loads all its segments in order, keyed by their first
+ * frame like the window does, and compressed recordings are unpacked block
+ * by block.
+ * @param recording
+ */
+void BatchRenderer::load (Recording *recording)
+{
+    double key = 0;
+    if (!recording->fileName.endsWith (SEGMENT_INDEX_SUFFIX, Qt::CaseInsensitive))
+      {
+        recording->loaded = loadFile (recording->fileName, recording, key);
+        return;
+      }
+
+    const QVector<SegmentInfo> segments = CsvRecorder::readIndex (recording->fileName);
+    if (segments.isEmpty())
+      {
+        return;
+      }
+    key = double (segments.first().firstFrame);
+    for (int i = 0; i < segments.size(); i++)
+      {
+        if (!loadFile (segments[i].fileName, recording, key))
+          {
+            return;
+          }
+      }
+    recording->loaded = true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Append one plain or compressed CSV file to a recording's store
+ * @param fileName
+ * @param recording The header, if any, is taken from the first file
+ * @param key Key of the next frame, advanced past the frames loaded
+ * @return false if the file cannot be read
+ */
+bool BatchRenderer::loadFile (const QString &fileName, Recording *recording, double &key)
+{
+    QFile file (fileName);
+    if (!file.open (QIODevice::ReadOnly))
+      {
+        return false;
+      }
+    const qint64 fileSize = file.size();
+    if (fileSize == 0)
+      {
+        return true;                                                                      // Segment started, nothing written
+      }
+    const char *data = reinterpret_cast<const char*> (file.map (0, fileSize));
+    if (data == nullptr)
+      {
+        return false;
+      }
+
+    SampleBatch batch;
+    bool ok = true;
+    if (fileName.endsWith (PACKED_SUFFIX, Qt::CaseInsensitive))
+      {
+        const QVector<PackedBlock> blocks = CsvRecorder::readBlocks (data, fileSize);
+        /* A segment closed before its first block only has the file header */
+        ok = !blocks.isEmpty() || (fileSize >= 8 && qFromLittleEndian<quint32> (reinterpret_cast<const uchar*> (data)) == PACKED_MAGIC);
+        for (int i = 0; ok && i < blocks.size(); i++)
+          {
+            const char *payload = data + blocks[i].offset;
+            const QByteArray text = blocks[i].compressed ? qUncompress (reinterpret_cast<const uchar*> (payload), blocks[i].packedSize)
+                                                         : QByteArray::fromRawData (payload, blocks[i].packedSize);
+            ok = !text.isEmpty() || blocks[i].rawSize == 0;
+            batch.clear();
+            CsvImporter::parse (text.constData(), text.constData() + text.size(), batch);
+            key = double (blocks[i].firstFrame);
+            append (recording, key, batch);
+          }
+      }
+    else
+      {
+        const char *end = data + fileSize;
+        QStringList names;
+        const char *begin = CsvImporter::readHeader (data, end, names);
+        if (recording->store.channelCount() == 0 && recording->names.isEmpty())
+          {
+            recording->names = names;
+          }
+        while (begin < end)
+          {
+            const char *chunkEnd = CsvImporter::chunkEnd (begin, end);
+            batch.clear();
+            CsvImporter::parse (begin, chunkEnd, batch);
+            append (recording, key, batch);
+            begin = chunkEnd;
+          }
+      }
+    file.unmap (reinterpret_cast<uchar*> (const_cast<char*> (data)));
+    return ok;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Store parsed frames, adding the channels they bring
+ * @param recording
+ * @param key Key of the first frame, advanced past them
+ * @param batch
+ */
+void BatchRenderer::append (Recording *recording, double &key, const SampleBatch &batch)
+{
+    while (recording->store.channelCount() < batch.channels.size())
+      {
+        recording->store.addChannel();
+      }
+    recording->store.append (key, batch);
+    key += batch.frames;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Plot the selected channels of a loaded recording and save the image
+ * @param recording
+ * @return false if nothing could be written
+ */
+bool BatchRenderer::render (Recording *recording)
+{
+    QTextStream err (stderr);
+    const ChannelStore &store = recording->store;
+
+    /* Resolve the channel list against this recording's header */
+    QVector<int> shown;
+    if (channelSpec.isEmpty())
+      {
+        for (int c = 0; c < store.channelCount(); c++)
+          {
+            shown.append (c);
+          }
+      }
+    foreach (const QString &spec, channelSpec)
+      {
+        bool ok;
+        int channel = spec.toInt (&ok);
+        if (!ok)
+          {
+            channel = recording->names.indexOf (spec.trimmed());
+          }
+        if (channel < 0 || channel >= store.channelCount())
+          {
+            err << recording->fileName << ": no channel " << spec << endl;
+            continue;
+          }
+        shown.append (channel);
+      }
+
+    plot.clearPlottables();
+    const QCPRange keyRange (hasFrom ? from : store.firstKey(), hasTo ? to : store.lastKey());
+    QCPRange valueRange;
+    bool haveValues = false;
+    for (int i = 0; i < shown.size(); i++)
+      {
+        const int channel = shown[i];
+        ChannelView *view = new ChannelView (plot.xAxis, plot.yAxis, &store, channel);
+        view->setPen (QColor (traceColors[i % (sizeof (traceColors) / sizeof (traceColors[0]))]));
+        view->setName (channel < recording->names.size() ? recording->names[channel] : QString ("Channel %1").arg (channel));
+
+        bool found;
+        const QCPRange range = view->getValueRange (found, QCP::sdBoth, keyRange);
+        if (found)
+          {
+            valueRange = haveValues ? QCPRange (qMin (valueRange.lower, range.lower), qMax (valueRange.upper, range.upper)) : range;
+            haveValues = true;
+          }
+      }
+
+    plot.xAxis->setRange (keyRange);
+    if (haveValues)
+      {
+        const double margin = qMax (valueRange.size() * 0.05, 0.5);
+        plot.yAxis->setRange (valueRange.lower - margin, valueRange.upper + margin);
+      }
+    QFileInfo info (recording->fileName);
+    title->setText (info.fileName());
+
+    const QString fileName = QDir (outputDir.isEmpty() ? info.absolutePath() : outputDir).filePath (info.completeBaseName() + "." + format);
+    bool saved;
+    if (format == "pdf")
+      {
+        saved = plot.savePdf (fileName, size.width(), size.height());
+      }
+    else if (format == "svg")
+      {
+        QSvgGenerator generator;
+        generator.setFileName (fileName);
+        generator.setSize (size);
+        generator.setViewBox (QRect (QPoint (0, 0), size));
+        generator.setTitle (info.fileName());
+        QCPPainter painter;
+        saved = painter.begin (&generator);
+        if (saved)
+          {
+            plot.toPainter (&painter, size.width(), size.height());
+            painter.end();
+          }
+      }
+    else
+      {
+        saved = plot.savePng (fileName, size.width(), size.height());
+      }
+
+    if (!saved)
+      {
+        err << "Cannot write " << fileName << endl;
+        return false;
+      }
+    QTextStream (stdout) << recording->fileName << " -> " << fileName << endl;
+    return true;
+}
@@ -0,0 +1,81 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef BATCHRENDERER_HPP
+#define BATCHRENDERER_HPP
+
+#include <QStringList>
+#include <QSize>
+#include <QDir>
+#include "channelstore.hpp"
+#include "qcustomplot/qcustomplot.h"
+
+/**
+ * @brief Renders CSV recordings to PNG/SVG/PDF without the window ("--render")
+ *
+ * Plain and compressed (PACKED_SUFFIX) recordings are accepted, and so is
+ * the index of a segmented recording, which renders all its segments.
+ *
+ * Recordings are loaded into a ChannelStore on a thread pool, several at
+ * a time. The plot is a widget, so it renders on the GUI thread, in command
+ * line order, as soon as each recording is loaded; ChannelView draws from the
+ * block summaries wherever a pixel column spans whole blocks.
+ */
+class BatchRenderer
+{
+public:
+    BatchRenderer();
+
+    static bool requested (int argc, char *argv[]);                                       // "--render" on the command line
+    int run (const QStringList &arguments);                                               // Returns the exit code
+
+private:
+    struct Recording
+    {
+        QString fileName;
+        QStringList names;                                                                // Header line, if any
+        ChannelStore store;
+        bool loaded = false;
+    };
+
+    QCustomPlot plot;
+    QCPTextElement *title;                                                                // Recording name above the axes
+    QStringList channelSpec;                                                              // Indexes or names, empty for all
+    bool hasFrom = false;
+    bool hasTo = false;
+    double from = 0;
+    double to = 0;
+    QString format;
+    QSize size;
+    QString outputDir;                                                                    // Empty: next to the recording
+
+    static void load (Recording *recording);
+    static bool loadFile (const QString &fileName, Recording *recording, double &key);
+    static void append (Recording *recording, double &key, const SampleBatch &batch);
+    bool render (Recording *recording);
+};
+
+#endif // BATCHRENDERER_HPP
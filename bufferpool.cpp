@@ -0,0 +1,144 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "bufferpool.hpp"
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+/**
+ * @brief Constructor, allocates every buffer up front
+ * @param count
+ * @param bytes Size of each buffer
+ */
+BufferPool::BufferPool (int count, int bytes) :
+  fewest (count),
+  misses (0)
+{
+    idle.reserve (count);
+    for (int i = 0; i < count; i++)
+      {
+        ReadBuffer *buffer = new ReadBuffer;
+        buffer->data.resize (bytes);
+        buffer->size = 0;
+        buffers.append (buffer);
+        idle.append (buffer);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor, every buffer must have been given back
+ */
+BufferPool::~BufferPool()
+{
+    qDeleteAll (buffers);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Take a free buffer
+ * @return nullptr if none is free, counted in exhausted()
+ */
+ReadBuffer *BufferPool::acquire()
+{
+    QMutexLocker locker (&lock);
+    if (idle.isEmpty())
+      {
+        misses++;
+        return nullptr;
+      }
+    ReadBuffer *buffer = idle.last();
+    idle.removeLast();
+    fewest = qMin (fewest, idle.size());
+    buffer->size = 0;
+    return buffer;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Give a buffer back, from any thread
+ * @param buffer
+ */
+void BufferPool::release (ReadBuffer *buffer)
+{
+    QMutexLocker locker (&lock);
+    idle.append (buffer);                                                                 // Within the reserved size, no allocation
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Lock every buffer in physical memory so a read never waits for a page fault
+ * @return false if the system refused (e.g. RLIMIT_MEMLOCK) or cannot do it
+ */
+bool BufferPool::lockMemory()
+{
+#ifdef Q_OS_UNIX
+    QMutexLocker locker (&lock);
+    bool locked = true;
+    for (int i = 0; i < buffers.size(); i++)
+      {
+        locked = mlock (buffers[i]->data.constData(), size_t (buffers[i]->data.size())) == 0 && locked;
+      }
+    return locked;
+#else
+    return false;
+#endif
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Free buffers right now
+ * @return
+ */
+int BufferPool::available()
+{
+    QMutexLocker locker (&lock);
+    return idle.size();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Fewest free buffers since the pool was created
+ * @return
+ */
+int BufferPool::lowWater()
+{
+    QMutexLocker locker (&lock);
+    return fewest;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief How many times acquire() found the pool empty
+ * @return
+ */
+qint64 BufferPool::exhausted()
+{
+    QMutexLocker locker (&lock);
+    return misses;
+}
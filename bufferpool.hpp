@@ -0,0 +1,82 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+
+#include <QByteArray>
+#include <QVector>
+#include <QMutex>
+
+#define POOL_BUFFERS         16                                                           // Read buffers per pool
+#define POOL_BUFFER_BYTES    (64 * 1024)                                                  // Bytes per read buffer
+
+/**
+ * @brief One read worth of received bytes
+ */
+struct ReadBuffer
+{
+    QByteArray data;                                                                      // Allocated once, never resized
+    int size;                                                                             // Bytes in use
+
+    char *bytes() { return data.data(); }
+    const char *constBytes() const { return data.constData(); }
+    int capacity() const { return data.size(); }
+};
+
+/**
+ * @brief Fixed set of preallocated read buffers cycled through the ingest path
+ *
+ * A buffer is taken for a read from the port, handed on to the parser
+ * and given back once its bytes are in the batch, so steady state ingest
+ * allocates nothing. acquire() may be called from any thread. Running out
+ * is not an error: the caller keeps the bytes in the port's buffer or
+ * falls back to an allocation, and exhausted() counts how often it did.
+ */
+class BufferPool
+{
+public:
+    BufferPool (int count = POOL_BUFFERS, int bytes = POOL_BUFFER_BYTES);
+    ~BufferPool();
+
+    ReadBuffer *acquire();                                                                // nullptr when every buffer is in use
+    void release (ReadBuffer *buffer);
+    bool lockMemory();                                                                    // Keep every buffer in RAM (mlock)
+
+    int count() const { return buffers.size(); }
+    int available();
+    int lowWater();                                                                       // Fewest free buffers seen
+    qint64 exhausted();                                                                   // acquire() calls that found none
+
+private:
+    QVector<ReadBuffer*> buffers;
+    QVector<ReadBuffer*> idle;
+    int fewest;
+    qint64 misses;
+    QMutex lock;
+};
+
+#endif // BUFFERPOOL_HPP
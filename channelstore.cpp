@@ -0,0 +1,791 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "channelstore.hpp"
+#include "columncodec.hpp"
+#include <QtConcurrent>
+#include <QtMath>
+#include <QtNumeric>
+#include <algorithm>
+
+/**
+ * @brief Packed columns a thread decoded last
+ *
+ * Views read the same packed columns, whole or a few samples of them, on
+ * every repaint; keeping them decoded leaves one unpacking per column
+ * instead of one per read. Packed bytes never change, so the pack id is enough.
+ */
+struct DecodedColumn
+{
+    quint64 packId;
+    QVector<double> values;
+
+    DecodedColumn() : packId (0) {}
+};
+static thread_local DecodedColumn decodedColumns[STORE_DECODED_COLUMNS];
+static thread_local int nextDecodedColumn = 0;
+static QAtomicInteger<quint64> lastPackId;
+
+/**
+ * @brief Bytes per sample
+ * @param type
+ */
+int StoreColumn::typeSize (StoreType type)
+{
+    switch (type)
+      {
+      case StoreInt16:
+        return 2;
+      case StoreInt32:
+      case StoreFloat:
+        return 4;
+      default:
+        return 8;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Narrowest type that stores 'value' without loss
+ *
+ * Integers go to int16/int32 (the lowest value of each is reserved for NaN),
+ * the rest to float when it round-trips, otherwise double.
+ * @param value
+ */
+StoreType StoreColumn::fitType (double value)
+{
+    if (qIsNaN (value))
+      {
+        return StoreInt16;
+      }
+    if (value == std::floor (value))
+      {
+        if (value >= -32767 && value <= 32767)
+          {
+            return StoreInt16;
+          }
+        if (value >= -2147483647.0 && value <= 2147483647.0)
+          {
+            return StoreInt32;
+          }
+      }
+    if (double (float (value)) == value)
+      {
+        return StoreFloat;
+      }
+    return StoreDouble;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Narrowest type holding the values of both, float cannot hold all int32
+ * @param a
+ * @param b
+ */
+StoreType StoreColumn::widerType (StoreType a, StoreType b)
+{
+    if (a == b || b == StoreInt16)
+      {
+        return a;
+      }
+    if (a == StoreInt16)
+      {
+        return b;
+      }
+    return StoreDouble;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Change the sample width, converting what is already stored
+ * @param type
+ */
+void StoreColumn::setType (StoreType type)
+{
+    if ((type == mType && !mPacked) || type == StoreAuto)
+      {
+        return;
+      }
+
+    QVector<double> stored (mCount);
+    read (0, mCount, stored.data());
+    mType = type;
+    mCount = 0;
+    mPacked = false;
+    mPackId = 0;
+    mData.clear();
+    mData.reserve (STORE_BLOCK_FRAMES * typeSize (type));
+    append (stored.constData(), stored.size());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Append samples, converted to the column width
+ * @param values
+ * @param count
+ */
+void StoreColumn::append (const double *values, int count)
+{
+    if (mPacked)
+      {
+        setType (mType);                                                                  // Unpacks, cold blocks are not appended to
+      }
+    if (mData.capacity() == 0)
+      {
+        mData.reserve (STORE_BLOCK_FRAMES * typeSize (mType));
+      }
+    mData.resize ((mCount + count) * typeSize (mType));
+
+    switch (mType)
+      {
+      case StoreInt16:
+        {
+          qint16 *out = reinterpret_cast<qint16*> (mData.data()) + mCount;
+          for (int i = 0; i < count; i++)
+            {
+              out[i] = qIsNaN (values[i]) ? qint16 (STORE_MISSING_INT16) : qint16 (qRound (qBound (-32767.0, values[i], 32767.0)));
+            }
+          break;
+        }
+      case StoreInt32:
+        {
+          qint32 *out = reinterpret_cast<qint32*> (mData.data()) + mCount;
+          for (int i = 0; i < count; i++)
+            {
+              out[i] = qIsNaN (values[i]) ? qint32 (STORE_MISSING_INT32) : qint32 (qRound (qBound (-2147483647.0, values[i], 2147483647.0)));
+            }
+          break;
+        }
+      case StoreFloat:
+        {
+          float *out = reinterpret_cast<float*> (mData.data()) + mCount;
+          for (int i = 0; i < count; i++)
+            {
+              out[i] = float (values[i]);
+            }
+          break;
+        }
+      default:
+        memcpy (mData.data() + mCount * sizeof (double), values, count * sizeof (double));
+        break;
+      }
+    mCount += count;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Append frames without value
+ * @param count
+ */
+void StoreColumn::appendMissing (int count)
+{
+    QVector<double> missing (count, qQNaN());
+    append (missing.constData(), count);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Widen a run of samples to double, NaN where there is no value
+ * @param first
+ * @param count
+ * @param out
+ */
+void StoreColumn::read (int first, int count, double *out) const
+{
+    QMutexLocker locker (mDisk != nullptr ? mDisk->readLock() : nullptr);                 // Views may render on several threads
+    const char *data = mDisk != nullptr ? mDisk->map (mSegment, mOffset, mDiskBytes) : mData.constData();
+    const int size = mDisk != nullptr ? mDiskBytes : mData.size();
+    if (data == nullptr)
+      {
+        for (int i = 0; i < count; i++)
+          {
+            out[i] = qQNaN();                                                             // Scrollback file is gone
+          }
+        return;
+      }
+
+    if (mPacked)
+      {
+        /* Whole columns too: the reducer reads every block it cannot summarize in full */
+        DecodedColumn *decoded = nullptr;
+        for (int i = 0; i < STORE_DECODED_COLUMNS && decoded == nullptr; i++)
+          {
+            if (decodedColumns[i].packId == mPackId)
+              {
+                decoded = &decodedColumns[i];
+              }
+          }
+        if (decoded == nullptr)
+          {
+            decoded = &decodedColumns[nextDecodedColumn];
+            nextDecodedColumn = (nextDecodedColumn + 1) % STORE_DECODED_COLUMNS;
+            decoded->values.resize (mCount);                                              // Keeps its capacity, no allocation once warm
+            ColumnCodec::decode (mType, data, size, mCount, decoded->values.data());
+            decoded->packId = mPackId;
+          }
+        memcpy (out, decoded->values.constData() + first, count * sizeof (double));
+        return;
+      }
+
+    switch (mType)
+      {
+      case StoreInt16:
+        {
+          const qint16 *in = reinterpret_cast<const qint16*> (data) + first;
+          for (int i = 0; i < count; i++)
+            {
+              out[i] = in[i] == STORE_MISSING_INT16 ? qQNaN() : double (in[i]);
+            }
+          break;
+        }
+      case StoreInt32:
+        {
+          const qint32 *in = reinterpret_cast<const qint32*> (data) + first;
+          for (int i = 0; i < count; i++)
+            {
+              out[i] = in[i] == STORE_MISSING_INT32 ? qQNaN() : double (in[i]);
+            }
+          break;
+        }
+      case StoreFloat:
+        {
+          const float *in = reinterpret_cast<const float*> (data) + first;
+          for (int i = 0; i < count; i++)
+            {
+              out[i] = double (in[i]);
+            }
+          break;
+        }
+      default:
+        memcpy (out, data + first * sizeof (double), count * sizeof (double));
+        break;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief One sample widened to double
+ * @param frame
+ */
+double StoreColumn::value (int frame) const
+{
+    double out;
+    read (frame, 1, &out);
+    return out;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Packed copy of the column
+ */
+StoreColumn StoreColumn::packed() const
+{
+    StoreColumn column (*this);
+    if (!mPacked && mDisk == nullptr && mCount > 0)
+      {
+        column.mData = ColumnCodec::encode (mType, mData.constData(), mCount);
+        column.mPacked = true;
+        column.mPackId = lastPackId.fetchAndAddRelaxed (1) + 1;
+      }
+    return column;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Write the column bytes to the scrollback files and free them
+ * @param disk
+ * @return false if writing failed, the column is then unchanged
+ */
+bool StoreColumn::spill (DiskTier *disk)
+{
+    if (mDisk != nullptr || mCount == 0)
+      {
+        return true;
+      }
+    if (!disk->write (mData, mSegment, mOffset))
+      {
+        return false;
+      }
+    mDisk = disk;
+    mDiskFiles = disk->segments();
+    mDiskBytes = mData.size();
+    mData = QByteArray();
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Pack every column of a block, runs on the thread pool
+ * @param block Copy of a cold block
+ */
+static StoreBlock packBlock (StoreBlock block)
+{
+    for (int c = 0; c < block.values.size(); c++)
+      {
+        block.values[c] = block.values[c].packed();
+      }
+    return block;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief First frame with a key >= 'key', 'frames' if none
+ * @param key
+ */
+int StoreBlock::findFrame (double key) const
+{
+    if (keys.isEmpty())
+      {
+        return int (qBound (0.0, std::ceil (key - firstKey), double (frames)));
+      }
+    return int (std::lower_bound (keys.constBegin(), keys.constEnd(), key) - keys.constBegin());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Memory used by keys and samples
+ */
+qint64 StoreBlock::bytes() const
+{
+    qint64 total = keys.size() * sizeof (double);
+    for (int c = 0; c < values.size(); c++)
+      {
+        total += values[c].bytes();
+      }
+    return total;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ */
+ChannelStore::ChannelStore() :
+    mChannels (0),
+    mFrames (0),
+    mBudget (0),
+    mBytes (0),
+    mNextPack (0),
+    mNextSpill (0),
+    mGeneration (0),
+    mPackingGeneration (0),
+    mVersion (0),
+    mSealedChanged (false),
+    mPublished (new StoreSnapshot),
+    mReaders (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor, lets a running packing job finish
+ */
+ChannelStore::~ChannelStore()
+{
+    mPacking.waitForFinished();
+    for (int i = 0; i < mRetired.size(); i++)
+      {
+        release (mRetired[i]);
+      }
+    release (mPublished.loadAcquire());                                                   // Readers still holding one free it
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Drop all frames and channels, the byte budget is kept
+ */
+void ChannelStore::clear()
+{
+    mBlocks.clear();
+    mTypes.clear();
+    mFixed.clear();
+    mChannels = 0;
+    mFrames = 0;
+    mBytes = 0;
+    mNextPack = 0;
+    mNextSpill = 0;
+    mGeneration++;
+    mDisk.clear();
+    mVersion++;
+    mSealedChanged = true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Add a channel, it has no value in the frames already stored
+ * @return Channel index
+ */
+int ChannelStore::addChannel()
+{
+    for (int b = 0; b < mBlocks.size(); b++)
+      {
+        mBlocks[b].values.append (StoreColumn());
+        mBlocks[b].minimum.append (qQNaN());
+        mBlocks[b].maximum.append (qQNaN());
+        mBlocks[b].firstValue.append (qQNaN());
+        mBlocks[b].lastValue.append (qQNaN());
+      }
+    mTypes.append (StoreInt16);
+    mFixed.append (false);
+    mVersion++;
+    mSealedChanged = true;
+    return mChannels++;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Sample width for new samples of a channel
+ *
+ * StoreAuto starts from int16 and widens as soon as a value does not fit.
+ * A fixed type rounds and clamps the values that do not fit; it also
+ * converts the block being filled so the setting applies right away.
+ * @param channel
+ * @param type
+ */
+void ChannelStore::setChannelType (int channel, StoreType type)
+{
+    mFixed[channel] = type != StoreAuto;
+    mTypes[channel] = type == StoreAuto ? StoreInt16 : type;
+
+    if (mFixed[channel] && !mBlocks.isEmpty() && !mBlocks.last().values[channel].isEmpty())
+      {
+        StoreBlock &block = mBlocks.last();
+        mBytes -= block.bytes();
+        block.values[channel].setType (type);
+        mBytes += block.bytes();
+        mVersion++;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Limit the memory used by the history
+ * @param bytes Budget, 0 for no limit
+ */
+void ChannelStore::setByteBudget (qint64 bytes)
+{
+    mBudget = bytes;
+    enforceBudget();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Move the oldest blocks to disk while over budget, the newest block always stays
+ *
+ * Without a usable scrollback directory the block is dropped instead.
+ */
+void ChannelStore::enforceBudget()
+{
+    while (mBudget > 0 && mBytes > mBudget && mNextSpill < mBlocks.size() - 1)
+      {
+        StoreBlock &block = mBlocks[mNextSpill];
+        mBytes -= block.bytes();
+
+        const qint64 diskBytes = mDisk.bytes();
+        bool spilled = true;
+        for (int c = 0; c < block.values.size() && spilled; c++)
+          {
+            spilled = block.values[c].spill (&mDisk);
+          }
+        mVersion++;
+        mSealedChanged = true;
+        if (spilled)
+          {
+            mBytes += block.bytes();
+            mNextSpill++;
+            continue;
+          }
+
+        mDisk.rollback (diskBytes);                                                       // Columns of the block written before the failure
+        mFrames -= block.frames;
+        mBlocks.remove (mNextSpill);
+        if (mNextPack > mNextSpill)
+          {
+            mNextPack--;
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Last block if it still has room, otherwise a new empty one
+ * @param key Key of the next frame, stored keys start when it is not consecutive
+ */
+StoreBlock &ChannelStore::writableBlock (double key)
+{
+    if (mBlocks.isEmpty() || mBlocks.last().frames >= STORE_BLOCK_FRAMES)
+      {
+        StoreBlock block;
+        block.firstKey = key;
+        block.values.resize (mChannels);
+        block.minimum.fill (qQNaN(), mChannels);
+        block.maximum.fill (qQNaN(), mChannels);
+        block.firstValue.fill (qQNaN(), mChannels);
+        block.lastValue.fill (qQNaN(), mChannels);
+        mBlocks.append (block);
+        mSealedChanged = true;                                                            // The previous newest one is sealed
+      }
+
+    StoreBlock &block = mBlocks.last();
+    if (block.keys.isEmpty() && block.frames > 0 && key != block.firstKey + block.frames)
+      {
+        block.keys.reserve (STORE_BLOCK_FRAMES);
+        for (int f = 0; f < block.frames; f++)
+          {
+            block.keys.append (block.firstKey + f);
+          }
+      }
+    return block;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Append the frames of a batch, one key per frame
+ *
+ * Columns of 'batch' map to channels by index; channels without a column
+ * get NaN, columns beyond channelCount() are ignored. In automatic mode a
+ * column is widened when a value does not fit its type.
+ * @param firstKey Key of the first frame
+ * @param batch
+ */
+void ChannelStore::append (double firstKey, const SampleBatch &batch)
+{
+    int done = 0;
+    while (done < batch.frames)
+      {
+        StoreBlock &block = writableBlock (firstKey + done);
+        const int start = block.frames;
+        const int count = qMin (batch.frames - done, STORE_BLOCK_FRAMES - start);
+        mBytes -= block.bytes();
+
+        if (!block.keys.isEmpty())
+          {
+            for (int f = 0; f < count; f++)
+              {
+                block.keys.append (firstKey + done + f);
+              }
+          }
+
+        for (int c = 0; c < mChannels; c++)
+          {
+            StoreColumn &column = block.values[c];
+            if (!batch.hasChannel (c))
+              {
+                if (!column.isEmpty())
+                  {
+                    column.appendMissing (count);
+                  }
+                continue;
+              }
+
+            const double *in = batch.channels[c].constData() + done;
+            StoreType type = column.isEmpty() ? mTypes[c] : column.type();
+            double minimum = block.minimum[c];
+            double maximum = block.maximum[c];
+            for (int f = 0; f < count; f++)
+              {
+                const double value = in[f];
+                if (qIsNaN (value))
+                  {
+                    continue;
+                  }
+                if (qIsNaN (block.firstValue[c]))
+                  {
+                    block.firstValue[c] = value;
+                  }
+                block.lastValue[c] = value;
+                if (!mFixed[c])
+                  {
+                    type = StoreColumn::widerType (type, StoreColumn::fitType (value));
+                  }
+                if (!(value >= minimum))
+                  {
+                    minimum = value;                                                      // Also replaces the initial NaN
+                  }
+                if (!(value <= maximum))
+                  {
+                    maximum = value;
+                  }
+              }
+            block.minimum[c] = minimum;
+            block.maximum[c] = maximum;
+
+            if (column.isEmpty())
+              {
+                column.setType (type);
+                column.appendMissing (start);
+              }
+            else
+              {
+                column.setType (type);
+              }
+            mTypes[c] = type;
+            column.append (in, count);
+          }
+
+        block.frames += count;
+        mBytes += block.bytes();
+        done += count;
+        mFrames += count;
+        mVersion++;
+      }
+    enforceBudget();
+    packColdBlocks();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Swap in the block packed in background and start packing the next cold one
+ *
+ * The job works on a copy of the block (the buffers are shared, not copied),
+ * cold blocks are not written anymore so the copy stays identical. Only
+ * columns added meanwhile by addChannel() are missing from the result.
+ */
+void ChannelStore::packColdBlocks()
+{
+    if (mPacking.isRunning())
+      {
+        return;
+      }
+
+    if (mPacking.isFinished() && mPacking.resultCount() > 0)
+      {
+        const StoreBlock packed = mPacking.result();
+        mPacking = QFuture<StoreBlock>();
+
+        const int b = findBlock (packed.firstKey);
+        if (packed.frames > 0 && mPackingGeneration == mGeneration && b >= mNextSpill && b < mBlocks.size() && mBlocks[b].firstKey == packed.firstKey)
+          {
+            StoreBlock &block = mBlocks[b];
+            mBytes -= block.bytes();
+            for (int c = 0; c < packed.values.size(); c++)
+              {
+                block.values[c] = packed.values[c];
+              }
+            mBytes += block.bytes();
+            mSealedChanged = true;                                                        // Lets the next snapshot drop the unpacked columns
+          }
+      }
+
+    mNextPack = qMax (mNextPack, mNextSpill);                                             // Spilled blocks stay as written
+    if (mNextPack < mBlocks.size() - STORE_HOT_BLOCKS)
+      {
+        mPackingGeneration = mGeneration;
+        mPacking = QtConcurrent::run (packBlock, mBlocks[mNextPack++]);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Make the current state the one acquire() returns
+ *
+ * Never waits: replaced snapshots are kept until no acquire() is between
+ * loading the pointer and taking its reference, then the store drops its
+ * reference to them. Call it once per displayed frame rather than per append,
+ * the next append copies the newest block if a reader still holds it.
+ */
+void ChannelStore::publish()
+{
+    StoreSnapshot *current = mPublished.loadAcquire();
+    if (current->version == mVersion)
+      {
+        return;
+      }
+
+    StoreSnapshot *snapshot = new StoreSnapshot;
+    snapshot->version = mVersion;
+    snapshot->frames = mFrames;
+    snapshot->channels = mChannels;
+    snapshot->sealed = mSealedChanged ? mBlocks.mid (0, qMax (0, mBlocks.size() - 1)) : current->sealed;
+    if (!mBlocks.isEmpty())
+      {
+        snapshot->newest.append (mBlocks.last());
+      }
+    mSealedChanged = false;
+    mRetired.append (mPublished.fetchAndStoreOrdered (snapshot));
+
+    /* Read-modify-write, so it sees any acquire() that may have loaded a retired pointer */
+    if (mReaders.testAndSetOrdered (0, 0))
+      {
+        for (int i = 0; i < mRetired.size(); i++)
+          {
+            release (mRetired[i]);
+          }
+        mRetired.clear();
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Reference to the last published snapshot, from any thread
+ * @return Never nullptr, give it back with release()
+ */
+StoreSnapshot *ChannelStore::acquire() const
+{
+    mReaders.ref();
+    StoreSnapshot *snapshot = mPublished.loadAcquire();
+    snapshot->ref.ref();
+    mReaders.deref();
+    return snapshot;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Drop a reference, the last one frees the snapshot
+ * @param snapshot
+ */
+void ChannelStore::release (StoreSnapshot *snapshot)
+{
+    if (!snapshot->ref.deref())
+      {
+        delete snapshot;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Binary search on the block key ranges
+ * @param blocks Blocks of a store or of a snapshot
+ * @param key
+ * @return Index of the first block whose last key is >= key, blocks.size() if none
+ */
+int ChannelStore::findBlock (const QVector<StoreBlock> &blocks, double key)
+{
+    int low = 0;
+    int high = blocks.size();
+    while (low < high)
+      {
+        const int middle = (low + high) / 2;
+        if (blocks[middle].lastKey() < key)
+          {
+            low = middle + 1;
+          }
+        else
+          {
+            high = middle;
+          }
+      }
+    return low;
+}
@@ -0,0 +1,229 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef CHANNELSTORE_HPP
+#define CHANNELSTORE_HPP
+
+#include <QVector>
+#include <QByteArray>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include "samplebatch.hpp"
+#include "disktier.hpp"
+
+#define STORE_BLOCK_FRAMES   4096                                                         // Frames per storage block
+#define STORE_MISSING_INT16  (-32768)                                                     // "No value" in integer columns
+#define STORE_MISSING_INT32  (-2147483647 - 1)
+#define STORE_HOT_BLOCKS     2                                                            // Newest blocks never packed
+#define STORE_DECODED_COLUMNS 8                                                           // Packed columns kept decoded per thread
+
+/**
+ * @brief Sample width of a column, StoreAuto picks the narrowest exact one
+ */
+enum StoreType
+{
+    StoreInt16,
+    StoreInt32,
+    StoreFloat,
+    StoreDouble,
+    StoreAuto
+};
+
+/**
+ * @brief Values of one channel inside a block, kept in their native width
+ *
+ * Samples are only widened to double when read. NaN ("no value") is the
+ * lowest integer in integer columns. Once a block is cold its columns are
+ * packed with ColumnCodec, reading then unpacks the whole column; the last
+ * columns a thread unpacked stay decoded. Evicted columns only keep where
+ * their bytes went in the DiskTier, and a reference to its segment files.
+ */
+class StoreColumn
+{
+public:
+    StoreColumn() : mType (StoreInt16), mCount (0), mPacked (false), mPackId (0), mDisk (nullptr), mSegment (0), mOffset (0), mDiskBytes (0) {}
+
+    bool isEmpty() const { return mCount == 0; }
+    int size() const { return mCount; }
+    StoreType type() const { return mType; }
+    int bytes() const { return mData.size(); }
+    bool isPacked() const { return mPacked; }
+    StoreColumn packed() const;                                                           // Read-only copy, safe from any thread
+    bool isSpilled() const { return mDisk != nullptr; }
+    bool spill (DiskTier *disk);                                                          // Move the bytes to disk
+
+    void setType (StoreType type);                                                        // Converts the stored values
+    void append (const double *values, int count);                                        // Rounded/clamped to the column type
+    void appendMissing (int count);
+    void read (int first, int count, double *out) const;                                  // Widen [first, first + count) to double
+    double value (int frame) const;
+
+    static int typeSize (StoreType type);
+    static StoreType fitType (double value);                                              // Narrowest type holding 'value' exactly
+    static StoreType widerType (StoreType a, StoreType b);                                // Narrowest type holding both
+
+private:
+    StoreType mType;
+    int mCount;
+    bool mPacked;
+    quint64 mPackId;                                                                      // Tells packed columns apart in the decoded cache
+    QByteArray mData;                                                                     // Raw samples or ColumnCodec output
+    DiskTier *mDisk;                                                                      // Set once the bytes are on disk
+    QSharedPointer<DiskSegments> mDiskFiles;                                              // Keeps them there
+    int mSegment;
+    qint64 mOffset;
+    int mDiskBytes;
+};
+
+/**
+ * @brief A run of consecutive frames: one key column shared by all channels
+ *
+ * Keys are not stored while they are firstKey, firstKey + 1, ... which is
+ * always the case for received data. A value column is empty when its
+ * channel had no value in the whole block. Extremes are kept per column so
+ * zoomed out views and autoscale can skip the samples.
+ */
+struct StoreBlock
+{
+    double firstKey;
+    int frames;
+    QVector<double> keys;                                                                 // Only for non consecutive keys
+    QVector<StoreColumn> values;
+    QVector<double> minimum;                                                              // Per channel, NaN if the column is empty
+    QVector<double> maximum;
+    QVector<double> firstValue;                                                           // First and last non-NaN sample, so
+    QVector<double> lastValue;                                                            // summaries need no unpacking
+
+    StoreBlock() : firstKey (0), frames (0) {}
+
+    double key (int frame) const { return keys.isEmpty() ? firstKey + frame : keys[frame]; }
+    double lastKey() const { return key (frames - 1); }
+    int findFrame (double key) const;                                                     // First frame with a key >= 'key'
+    qint64 bytes() const;
+};
+
+/**
+ * @brief State of a ChannelStore handed to other threads, never modified once published
+ *
+ * Blocks are implicit copies: the store detaches when it writes to a block
+ * a snapshot still holds. The sealed blocks are shared with the previous
+ * snapshot while none of them changed, so a publish usually costs the
+ * newest block only.
+ */
+struct StoreSnapshot
+{
+    QVector<StoreBlock> sealed;                                                           // Oldest to newest, without the block being filled
+    QVector<StoreBlock> newest;                                                           // Block being filled, if any
+    qint64 version;
+    qint64 frames;
+    int channels;                                                                         // Columns every block has
+    QAtomicInt ref;                                                                       // One for the store while current, one per reader
+
+    StoreSnapshot() : version (0), frames (0), channels (0), ref (1) {}
+
+    QVector<StoreBlock> blocks() const { return sealed + newest; }
+};
+
+/**
+ * @brief Columnar history of every channel
+ *
+ * Replaces one QCPGraphData {key, value} container per graph: the key is
+ * stored once per frame (or not at all) and each channel is a contiguous
+ * column in its own sample width. History is split in blocks of
+ * STORE_BLOCK_FRAMES frames to keep appends cheap and to allow block level
+ * summaries; with a byte budget set, the oldest blocks are dropped.
+ * Blocks older than the STORE_HOT_BLOCKS newest ones are packed one at a
+ * time on the thread pool and swapped in on the next append. Over the
+ * byte budget, the oldest blocks are spilled to the DiskTier (or dropped
+ * if it is not available); only their summaries stay in memory.
+ *
+ * The store itself belongs to one (writer) thread. Other threads read the
+ * StoreSnapshot last published by the writer, RCU style: acquire() never
+ * blocks and publish() never waits for readers, a replaced snapshot is
+ * freed by whoever drops the last reference once no acquire() can still
+ * be looking at it.
+ */
+class ChannelStore
+{
+public:
+    ChannelStore();
+    ~ChannelStore();
+
+    void clear();
+    int addChannel();                                                                     // Returns the new channel index
+    int channelCount() const { return mChannels; }
+    qint64 frameCount() const { return mFrames; }
+
+    void setChannelType (int channel, StoreType type);                                    // For new samples, StoreAuto by default
+    StoreType channelType (int channel) const { return mFixed[channel] ? mTypes[channel] : StoreAuto; }
+    void setByteBudget (qint64 bytes);                                                    // 0 keeps everything
+    qint64 byteBudget() const { return mBudget; }
+    qint64 bytes() const { return mBytes; }
+    qint64 diskBytes() const { return mDisk.bytes(); }
+
+    /* Append all frames of 'batch', keys are firstKey, firstKey + 1, ... */
+    void append (double firstKey, const SampleBatch &batch);
+
+    int blockCount() const { return mBlocks.size(); }
+    const StoreBlock &block (int index) const { return mBlocks[index]; }
+    int findBlock (double key) const { return findBlock (mBlocks, key); }
+    const QVector<StoreBlock> &blocks() const { return mBlocks; }                         // Copy for a snapshot, blocks are shared
+    static int findBlock (const QVector<StoreBlock> &blocks, double key);                 // First block ending at or after 'key'
+    double firstKey() const { return mBlocks.isEmpty() ? 0 : mBlocks.first().firstKey; }
+    double lastKey() const { return mBlocks.isEmpty() ? 0 : mBlocks.last().lastKey(); }
+
+    void publish();                                                                       // Writer thread, cheap when nothing changed
+    qint64 publishedVersion() const { return mPublished.loadAcquire()->version; }         // Writer thread
+    StoreSnapshot *acquire() const;                                                       // Any thread, give it back with release()
+    static void release (StoreSnapshot *snapshot);
+
+private:
+    QVector<StoreBlock> mBlocks;
+    int mChannels;
+    qint64 mFrames;
+    QVector<StoreType> mTypes;                                                            // Width new blocks start with
+    QVector<bool> mFixed;                                                                 // Type chosen by the user
+    qint64 mBudget;
+    qint64 mBytes;
+    int mNextPack;                                                                        // Blocks before it are packed or being packed
+    int mNextSpill;                                                                       // Blocks before it are on disk
+    DiskTier mDisk;
+    QFuture<StoreBlock> mPacking;
+    int mGeneration;                                                                      // Bumped by clear(), outdates mPacking
+    int mPackingGeneration;
+    qint64 mVersion;                                                                      // Bumped by every change
+    bool mSealedChanged;                                                                  // Blocks other than the newest changed since publish()
+    QAtomicPointer<StoreSnapshot> mPublished;
+    mutable QAtomicInt mReaders;                                                          // acquire() calls between loading mPublished and taking a reference
+    QVector<StoreSnapshot*> mRetired;                                                     // Replaced, the store's reference still held
+
+    StoreBlock &writableBlock (double key);                                               // Last block, a new one if full
+    void enforceBudget();
+    void packColdBlocks();
+};
+
+#endif // CHANNELSTORE_HPP
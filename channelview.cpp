@@ -0,0 +1,273 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "channelview.hpp"
+
+/**
+ * @brief Constructor
+ * @param keyAxis Horizontal axis
+ * @param valueAxis
+ * @param store History the view reads from, must outlive the view
+ * @param channel Column of the store
+ */
+ChannelView::ChannelView (QCPAxis *keyAxis, QCPAxis *valueAxis, const ChannelStore *store, int channel) :
+    QCPAbstractPlottable (keyAxis, valueAxis),
+    mStore (store),
+    mChannel (channel),
+    mDeferred (false)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Whether a painter maps pixels 1:1 onto a raster image (not an export or a HiDPI buffer)
+ * @param painter
+ * @return
+ */
+bool ChannelView::isRasterPainter (QPainter *painter)
+{
+    return painter->paintEngine()->type() == QPaintEngine::Raster && painter->deviceTransform().type() <= QTransform::TxTranslate;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Reduce the samples inside the key range plus one on each side to mLines
+ * @return false if there is no line to draw
+ */
+bool ChannelView::reduce()
+{
+    QCPAxis *keyAxis = mKeyAxis.data();
+    QCPAxis *valueAxis = mValueAxis.data();
+    if (!keyAxis || !valueAxis || mStore->blockCount() == 0)
+      {
+        return false;
+      }
+    TraceReducer::reduce (mStore->blocks(), mChannel, PixelMap (keyAxis, valueAxis), mLines, mValues);
+    return mLines.size() >= 2;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Draw the reduced trace
+ * @param painter
+ */
+void ChannelView::draw (QCPPainter *painter)
+{
+    if (mDeferred && isRasterPainter (painter))
+      {
+        return;                                                                           // TraceCompositor or TracePresenter draws it
+      }
+    if (!reduce())
+      {
+        return;
+      }
+    applyDefaultAntialiasingHint (painter);
+    const QPen pen = selected() ? mSelectionDecorator->pen() : mPen;
+
+    /* Exports (vector, scaled) and wide, dashed or antialiased lines keep the polyline */
+    if (!painter->antialiasing() && pen.style() == Qt::SolidLine && pen.widthF() <= 1 && isRasterPainter (painter))
+      {
+        mRaster.begin (clipRect());
+        mRaster.addPolyline (mLines.constData(), mLines.size());
+        mRaster.draw (painter, pen.color());
+        return;
+      }
+
+    painter->setPen (pen);
+    painter->setBrush (Qt::NoBrush);
+    painter->drawPolyline (mLines.constData(), mLines.size());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Rasterize the trace into a tile, 1 pixel wide in the pen color
+ *
+ * Only touches this view's scratch buffers, so views may render their tiles
+ * on different threads while the plot and the store are not modified.
+ * @param tile See TraceRaster::fill()
+ * @return Where the tile goes on the plot, empty if there is nothing to draw
+ */
+QRect ChannelView::renderTile (QImage &tile)
+{
+    if (!reduce())
+      {
+        return QRect();
+      }
+    mRaster.begin (clipRect());
+    mRaster.addPolyline (mLines.constData(), mLines.size());
+    return mRaster.fill (tile, (selected() ? mSelectionDecorator->pen() : mPen).color());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Legend icon is a line with the channel pen
+ * @param painter
+ * @param rect
+ */
+void ChannelView::drawLegendIcon (QCPPainter *painter, const QRectF &rect) const
+{
+    applyDefaultAntialiasingHint (painter);
+    painter->setPen (mPen);
+    painter->drawLine (QLineF (rect.left(), rect.center().y(), rect.right(), rect.center().y()));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Distance to the nearest sample within the selection tolerance
+ * @param pos
+ * @param onlySelectable
+ * @param details Gets a data selection, the view is selected as a whole
+ * @return Pixel distance, -1 if nothing is close
+ */
+double ChannelView::selectTest (const QPointF &pos, bool onlySelectable, QVariant *details) const
+{
+    QCPAxis *keyAxis = mKeyAxis.data();
+    QCPAxis *valueAxis = mValueAxis.data();
+    if ((onlySelectable && mSelectable == QCP::stNone) || !keyAxis || !valueAxis)
+      {
+        return -1;
+      }
+    if (!keyAxis->axisRect()->rect().contains (pos.toPoint()))
+      {
+        return -1;
+      }
+
+    const double tolerance = mParentPlot->selectionTolerance();
+    const QCPRange keys (keyAxis->pixelToCoord (pos.x() - tolerance), keyAxis->pixelToCoord (pos.x() + tolerance));
+    double best = -1;
+    for (int b = mStore->findBlock (keys.lower); b < mStore->blockCount(); b++)
+      {
+        const StoreBlock &block = mStore->block (b);
+        if (block.firstKey > keys.upper)
+          {
+            break;
+          }
+        const StoreColumn &column = block.values[mChannel];
+        if (column.isEmpty())
+          {
+            continue;
+          }
+        const int start = block.findFrame (keys.lower);
+        int end = start;
+        while (end < block.frames && block.key (end) <= keys.upper)
+          {
+            end++;
+          }
+        mValues.resize (end - start);
+        column.read (start, end - start, mValues.data());
+        for (int f = start; f < end; f++)
+          {
+            const double value = mValues[f - start];
+            if (qIsNaN (value))
+              {
+                continue;
+              }
+            const QPointF point (keyAxis->coordToPixel (block.key (f)), valueAxis->coordToPixel (value));
+            const double distance = QCPVector2D (point - pos).length();
+            if (best < 0 || distance < best)
+              {
+                best = distance;
+              }
+          }
+      }
+
+    if (best >= 0 && details)
+      {
+        details->setValue (QCPDataSelection (QCPDataRange (0, 1)));
+      }
+    return best;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Keys of the stored frames
+ */
+QCPRange ChannelView::getKeyRange (bool &foundRange, QCP::SignDomain inSignDomain) const
+{
+    Q_UNUSED (inSignDomain)
+    foundRange = mStore->blockCount() > 0;
+    return QCPRange (mStore->firstKey(), mStore->lastKey());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Extremes of the channel, only scanning blocks cut by 'inKeyRange'
+ */
+QCPRange ChannelView::getValueRange (bool &foundRange, QCP::SignDomain inSignDomain, const QCPRange &inKeyRange) const
+{
+    Q_UNUSED (inSignDomain)
+    const bool restricted = inKeyRange != QCPRange();
+    QCPRange range;
+    foundRange = false;
+
+    for (int b = restricted ? mStore->findBlock (inKeyRange.lower) : 0; b < mStore->blockCount(); b++)
+      {
+        const StoreBlock &block = mStore->block (b);
+        if (restricted && block.firstKey > inKeyRange.upper)
+          {
+            break;
+          }
+        if (qIsNaN (block.minimum[mChannel]))
+          {
+            continue;
+          }
+
+        if (!restricted || (block.firstKey >= inKeyRange.lower && block.lastKey() <= inKeyRange.upper))
+          {
+            if (!foundRange || block.minimum[mChannel] < range.lower)
+              {
+                range.lower = block.minimum[mChannel];
+              }
+            if (!foundRange || block.maximum[mChannel] > range.upper)
+              {
+                range.upper = block.maximum[mChannel];
+              }
+            foundRange = true;
+            continue;
+          }
+
+        mValues.resize (block.frames);
+        block.values[mChannel].read (0, block.frames, mValues.data());
+        for (int f = 0; f < block.frames; f++)
+          {
+            const double value = mValues[f];
+            if (qIsNaN (value) || !inKeyRange.contains (block.key (f)))
+              {
+                continue;
+              }
+            if (!foundRange || value < range.lower)
+              {
+                range.lower = value;
+              }
+            if (!foundRange || value > range.upper)
+              {
+                range.upper = value;
+              }
+            foundRange = true;
+          }
+      }
+    return range;
+}
@@ -0,0 +1,78 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef CHANNELVIEW_HPP
+#define CHANNELVIEW_HPP
+
+#include "qcustomplot/qcustomplot.h"
+#include "channelstore.hpp"
+#include "traceraster.hpp"
+#include "tracereducer.hpp"
+
+/**
+ * @brief Line plottable drawing one channel straight from the ChannelStore
+ *
+ * Takes the place of QCPGraph without a copy of the data. Samples are
+ * reduced to first/min/max/last per pixel column before drawing, blocks
+ * that fall inside a single pixel column only use their stored extremes.
+ * With a thin solid pen on a raster device the reduced trace is filled
+ * as column spans by TraceRaster instead of going through drawPolyline().
+ * The key axis must be the horizontal one.
+ */
+class ChannelView : public QCPAbstractPlottable
+{
+    Q_OBJECT
+
+public:
+    ChannelView (QCPAxis *keyAxis, QCPAxis *valueAxis, const ChannelStore *store, int channel);
+
+    int channel() const { return mChannel; }
+    const ChannelStore *store() const { return mStore; }
+    void setDeferred (bool deferred) { mDeferred = deferred; }                            // Leave raster drawing to TraceCompositor or TracePresenter
+    bool isDeferred() const { return mDeferred; }
+    QRect renderTile (QImage &tile);
+    static bool isRasterPainter (QPainter *painter);
+
+    virtual double selectTest (const QPointF &pos, bool onlySelectable, QVariant *details = 0) const Q_DECL_OVERRIDE;
+    virtual QCPRange getKeyRange (bool &foundRange, QCP::SignDomain inSignDomain = QCP::sdBoth) const Q_DECL_OVERRIDE;
+    virtual QCPRange getValueRange (bool &foundRange, QCP::SignDomain inSignDomain = QCP::sdBoth, const QCPRange &inKeyRange = QCPRange()) const Q_DECL_OVERRIDE;
+
+protected:
+    virtual void draw (QCPPainter *painter) Q_DECL_OVERRIDE;
+    virtual void drawLegendIcon (QCPPainter *painter, const QRectF &rect) const Q_DECL_OVERRIDE;
+
+private:
+    const ChannelStore *mStore;
+    int mChannel;
+    bool mDeferred;
+    QVector<QPointF> mLines;                                                              // Scratch for the reduced polyline
+    TraceRaster mRaster;
+    mutable QVector<double> mValues;                                                      // Block samples widened to double
+
+    bool reduce();
+};
+
+#endif // CHANNELVIEW_HPP
@@ -0,0 +1,220 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "columncodec.hpp"
+#include <QtNumeric>
+
+/**
+ * @brief Delta-of-delta, zigzag, 7 bits per byte
+ */
+template <typename T>
+static void encodeIntegers (const T *in, int count, QByteArray &out)
+{
+    qint64 previous = 0, delta = 0;
+    for (int i = 0; i < count; i++)
+      {
+        const qint64 current = in[i];
+        const qint64 deltaOfDelta = (current - previous) - delta;
+        delta = current - previous;
+        previous = current;
+
+        quint64 zigzag = (quint64 (deltaOfDelta) << 1) ^ quint64 (deltaOfDelta >> 63);
+        while (zigzag >= 0x80)
+          {
+            out.append (char (zigzag | 0x80));
+            zigzag >>= 7;
+          }
+        out.append (char (zigzag));
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @return Samples decoded before 'end'
+ */
+template <typename T>
+static int decodeIntegers (const uchar *in, const uchar *end, int count, double *out, qint64 missing)
+{
+    qint64 previous = 0, delta = 0;
+    for (int i = 0; i < count; i++)
+      {
+        quint64 zigzag = 0;
+        int shift = 0;
+        while (in < end && (*in & 0x80) && shift < 63)
+          {
+            zigzag |= quint64 (*in++ & 0x7f) << shift;
+            shift += 7;
+          }
+        if (in >= end)
+          {
+            return i;
+          }
+        zigzag |= quint64 (*in++) << shift;
+
+        delta += qint64 (zigzag >> 1) ^ -qint64 (zigzag & 1);
+        previous += delta;
+        out[i] = previous == missing ? qQNaN() : double (T (previous));
+      }
+    return count;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief XOR with the previous value, header byte is leading zero bytes << 4 | trailing zero bytes
+ */
+template <typename T, typename Bits>
+static void encodeFloats (const T *in, int count, QByteArray &out)
+{
+    Bits previous = 0;
+    for (int i = 0; i < count; i++)
+      {
+        Bits current;
+        memcpy (&current, &in[i], sizeof (Bits));
+        Bits xored = current ^ previous;
+        previous = current;
+
+        int leading = 0, trailing = 0;
+        while (leading < int (sizeof (Bits)) && ((xored >> (8 * (sizeof (Bits) - 1 - leading))) & 0xff) == 0)
+          {
+            leading++;
+          }
+        while (leading + trailing < int (sizeof (Bits)) && ((xored >> (8 * trailing)) & 0xff) == 0)
+          {
+            trailing++;
+          }
+
+        out.append (char ((leading << 4) | trailing));
+        for (int b = trailing; b < int (sizeof (Bits)) - leading; b++)
+          {
+            out.append (char (xored >> (8 * b)));
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @return Samples decoded before 'end'
+ */
+template <typename T, typename Bits>
+static int decodeFloats (const uchar *in, const uchar *end, int count, double *out)
+{
+    Bits previous = 0;
+    for (int i = 0; i < count; i++)
+      {
+        if (in >= end)
+          {
+            return i;
+          }
+        const int leading = *in >> 4;
+        const int trailing = *in++ & 0x0f;
+        if (end - in < int (sizeof (Bits)) - leading - trailing)
+          {
+            return i;
+          }
+        Bits xored = 0;
+        for (int b = trailing; b < int (sizeof (Bits)) - leading; b++)
+          {
+            xored |= Bits (*in++) << (8 * b);
+          }
+        previous ^= xored;
+
+        T value;
+        memcpy (&value, &previous, sizeof (Bits));
+        out[i] = double (value);
+      }
+    return count;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Pack raw column samples
+ * @param type Column type
+ * @param data Raw samples
+ * @param count Number of samples
+ * @return Packed bytes
+ */
+QByteArray ColumnCodec::encode (StoreType type, const char *data, int count)
+{
+    QByteArray packed;
+    packed.reserve (count * 2);
+    switch (type)
+      {
+      case StoreInt16:
+        encodeIntegers (reinterpret_cast<const qint16*> (data), count, packed);
+        break;
+      case StoreInt32:
+        encodeIntegers (reinterpret_cast<const qint32*> (data), count, packed);
+        break;
+      case StoreFloat:
+        encodeFloats<float, quint32> (reinterpret_cast<const float*> (data), count, packed);
+        break;
+      default:
+        encodeFloats<double, quint64> (reinterpret_cast<const double*> (data), count, packed);
+        break;
+      }
+    packed.squeeze();
+    return packed;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Unpack all samples of a column, widened to double
+ *
+ * Never reads past 'size' bytes: samples missing from truncated or damaged
+ * input are NaN.
+ * @param type Column type
+ * @param packed Output of encode()
+ * @param size Bytes in 'packed'
+ * @param count Number of samples
+ * @param out count values
+ * @return false if 'packed' ended before 'count' samples
+ */
+bool ColumnCodec::decode (StoreType type, const char *packed, int size, int count, double *out)
+{
+    const uchar *in = reinterpret_cast<const uchar*> (packed);
+    const uchar *end = in + size;
+    int decoded;
+    switch (type)
+      {
+      case StoreInt16:
+        decoded = decodeIntegers<qint16> (in, end, count, out, STORE_MISSING_INT16);
+        break;
+      case StoreInt32:
+        decoded = decodeIntegers<qint32> (in, end, count, out, STORE_MISSING_INT32);
+        break;
+      case StoreFloat:
+        decoded = decodeFloats<float, quint32> (in, end, count, out);
+        break;
+      default:
+        decoded = decodeFloats<double, quint64> (in, end, count, out);
+        break;
+      }
+    for (int i = decoded; i < count; i++)
+      {
+        out[i] = qQNaN();
+      }
+    return decoded == count;
+}
@@ -0,0 +1,48 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef COLUMNCODEC_HPP
+#define COLUMNCODEC_HPP
+
+#include <QByteArray>
+#include "channelstore.hpp"
+
+/**
+ * @brief Lossless packing of a column's samples
+ *
+ * Integer columns are stored as zigzag varints of the delta-of-delta, so a
+ * ramp or a slow signal costs about one byte per sample. Float and double
+ * columns XOR each value with the previous one and only keep the bytes
+ * between the leading and trailing zero bytes, behind a one byte header.
+ */
+class ColumnCodec
+{
+public:
+    static QByteArray encode (StoreType type, const char *data, int count);
+    static bool decode (StoreType type, const char *packed, int size, int count, double *out);  // NaN for missing samples
+};
+
+#endif // COLUMNCODEC_HPP
@@ -0,0 +1,365 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "csvimporter.hpp"
+#include "frameparser.hpp"
+#include <QThread>
+#include <QtConcurrent>
+#include <QtNumeric>
+
+/**
+ * @brief Constructor
+ * @param parent
+ */
+CsvImporter::CsvImporter (QObject *parent) :
+    QObject (parent),
+    startFrame (-1)
+{
+    connect (&pollTimer, SIGNAL (timeout()), this, SLOT (poll()));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor, stops the workers before unmapping
+ */
+CsvImporter::~CsvImporter()
+{
+    cancel();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Stop parsing and release the files
+ */
+void CsvImporter::cancel()
+{
+    canceled.storeRelease (1);
+    pool.waitForDone();
+    pollTimer.stop();
+    chunks.clear();
+    qDeleteAll (files);                                                                   // Closing unmaps
+    files.clear();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Map a file, read its header if any and start the parsing workers
+ * @param fileName
+ * @return false if the file cannot be mapped
+ */
+bool CsvImporter::open (const QString &fileName)
+{
+    return open (QStringList() << fileName);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Map the segments of a recording and parse them as if they were one file
+ *
+ * Empty segments are skipped; the header, if any, is taken from the first.
+ * Compressed segments only contribute the blocks overlapping [from, to].
+ * @param fileNames In recording order
+ * @param from msecs since epoch
+ * @param to
+ * @return false if a segment cannot be mapped or nothing is left to load
+ */
+bool CsvImporter::open (const QStringList &fileNames, qint64 from, qint64 to)
+{
+    cancel();
+    names.clear();
+    startFrame = -1;
+
+    foreach (const QString &fileName, fileNames)
+      {
+        QFile *file = new QFile (fileName);
+        files.append (file);
+        if (!file->open (QIODevice::ReadOnly))
+          {
+            cancel();
+            return false;
+          }
+        if (file->size() == 0)
+          {
+            continue;
+          }
+        const char *data = reinterpret_cast<const char*> (file->map (0, file->size()));
+        if (data == nullptr)
+          {
+            cancel();
+            return false;
+          }
+        if (fileName.endsWith (PACKED_SUFFIX, Qt::CaseInsensitive))
+          {
+            const QVector<PackedBlock> blocks = CsvRecorder::readBlocks (data, file->size());
+            for (int i = 0; i < blocks.size(); i++)
+              {
+                if (blocks[i].end < from || blocks[i].start > to)
+                  {
+                    continue;
+                  }
+                if (chunks.isEmpty())
+                  {
+                    startFrame = blocks[i].firstFrame;
+                  }
+                Chunk chunk;
+                chunk.begin = data + blocks[i].offset;
+                chunk.end = chunk.begin + blocks[i].packedSize;
+                chunk.packed = blocks[i].compressed;
+                chunks.append (chunk);
+              }
+            continue;
+          }
+
+        const char *end = data + file->size();
+        QStringList segmentNames;
+        const char *begin = readHeader (data, end, segmentNames);
+        if (chunks.isEmpty())
+          {
+            names = segmentNames;
+          }
+
+        while (begin < end)
+          {
+            Chunk chunk;
+            chunk.begin = begin;
+            chunk.end = chunkEnd (begin, end);
+            chunk.packed = false;
+            chunks.append (chunk);
+            begin = chunk.end;
+          }
+      }
+    if (chunks.isEmpty())
+      {
+        cancel();
+        return false;
+      }
+
+    nextChunk.storeRelease (0);
+    delivered.storeRelease (0);
+    canceled.storeRelease (0);
+    for (int i = 0; i < QThread::idealThreadCount(); i++)
+      {
+        QtConcurrent::run (&pool, this, &CsvImporter::work);
+      }
+    pollTimer.start (50);
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Read the header line, if the file has one
+ *
+ * A first line with letters (other than exponents) names the channels.
+ * @param begin Start of the file
+ * @param end
+ * @param names Gets the channel names, empty without header
+ * @return Start of the first frame
+ */
+const char *CsvImporter::readHeader (const char *begin, const char *end, QStringList &names)
+{
+    names.clear();
+    const char *lineEnd = static_cast<const char*> (memchr (begin, '\n', size_t (end - begin)));
+    if (lineEnd == nullptr)
+      {
+        lineEnd = end;
+      }
+    bool header = false;
+    for (const char *p = begin; p < lineEnd; p++)
+      {
+        if (isalpha ((unsigned char) *p) && *p != 'e' && *p != 'E')
+          {
+            header = true;
+            break;
+          }
+      }
+    if (!header)
+      {
+        return begin;
+      }
+
+    names = QString::fromUtf8 (begin, int (lineEnd - begin)).trimmed().split (',');
+    while (!names.isEmpty() && names.last().trimmed().isEmpty())
+      {
+        names.removeLast();
+      }
+    for (int i = 0; i < names.size(); i++)
+      {
+        names[i] = names[i].trimmed();
+      }
+    return qMin (lineEnd + 1, end);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief End of the chunk starting at 'begin': CSV_CHUNK_BYTES, extended to the end of the line
+ * @param begin
+ * @param end End of the file
+ * @return
+ */
+const char *CsvImporter::chunkEnd (const char *begin, const char *end)
+{
+    const char *chunkEnd = begin + qMin (qint64 (CSV_CHUNK_BYTES), qint64 (end - begin));
+    if (chunkEnd < end)
+      {
+        const char *newline = static_cast<const char*> (memchr (chunkEnd, '\n', size_t (end - chunkEnd)));
+        chunkEnd = newline != nullptr ? newline + 1 : end;
+      }
+    return chunkEnd;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Worker loop: take the next chunk, unless too far ahead of the consumer
+ */
+void CsvImporter::work()
+{
+    forever
+      {
+        const int index = nextChunk.fetchAndAddOrdered (1);
+        if (index >= chunks.size())
+          {
+            return;
+          }
+        while (index >= delivered.loadAcquire() + CSV_CHUNKS_AHEAD)
+          {
+            if (canceled.loadAcquire())
+              {
+                return;
+              }
+            QThread::msleep (5);
+          }
+        if (canceled.loadAcquire())
+          {
+            return;
+          }
+
+        Chunk &chunk = chunks.data()[index];                                              // Never detaches, the vector is not shared
+        if (chunk.packed)
+          {
+            const QByteArray text = qUncompress (reinterpret_cast<const uchar*> (chunk.begin), int (chunk.end - chunk.begin));
+            parse (text.constData(), text.constData() + text.size(), chunk.batch);
+          }
+        else
+          {
+            parse (chunk.begin, chunk.end, chunk.batch);
+          }
+        chunk.done.storeRelease (1);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse whole lines into columns, appended to 'batch'
+ *
+ * Fields are comma separated, an empty field means no value, and the empty
+ * field after a trailing comma (as written by the recorder) is ignored.
+ * @param begin
+ * @param end
+ * @param batch
+ */
+void CsvImporter::parse (const char *begin, const char *end, SampleBatch &batch)
+{
+    const char *p = begin;
+
+    while (p < end)
+      {
+        const char *lineEnd = static_cast<const char*> (memchr (p, '\n', size_t (end - p)));
+        if (lineEnd == nullptr)
+          {
+            lineEnd = end;
+          }
+        const char *lineStop = lineEnd;
+        if (lineStop > p && lineStop[-1] == '\r')
+          {
+            lineStop--;
+          }
+
+        if (lineStop > p)
+          {
+            const int frame = batch.frames++;
+            int field = 0;
+            const char *start = p;
+            for (const char *q = p; q <= lineStop; q++)
+              {
+                if (q < lineStop && *q != ',')
+                  {
+                    continue;
+                  }
+                if (q == lineStop && q == start && field > 0)
+                  {
+                    break;                                                                // Trailing comma
+                  }
+                if (batch.channels.size() <= field)
+                  {
+                    batch.channels.resize (field + 1);
+                  }
+                QVector<double> &column = batch.channels[field];
+                while (column.size() < frame)
+                  {
+                    column.append (qQNaN());
+                  }
+                column.append (q > start ? FrameParser::toDouble (start, q) : qQNaN());
+                field++;
+                start = q + 1;
+              }
+          }
+        p = lineEnd + 1;
+      }
+
+    for (int c = 0; c < batch.channels.size(); c++)
+      {
+        while (batch.channels[c].size() < batch.frames)
+          {
+            batch.channels[c].append (qQNaN());
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Hand out the chunks parsed so far, in file order
+ */
+void CsvImporter::poll()
+{
+    int index = delivered.loadAcquire();
+    while (index < chunks.size() && chunks.at (index).done.loadAcquire())
+      {
+        Chunk &chunk = chunks.data()[index];
+        if (chunk.batch.frames > 0)
+          {
+            emit batchReady (chunk.batch);
+          }
+        chunk.batch = SampleBatch();
+        delivered.storeRelease (++index);
+      }
+
+    emit progress (chunks.isEmpty() ? 100 : int (qint64 (index) * 100 / chunks.size()));
+    if (index == chunks.size())
+      {
+        cancel();
+        emit finished();
+      }
+}
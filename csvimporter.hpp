@@ -0,0 +1,105 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef CSVIMPORTER_HPP
+#define CSVIMPORTER_HPP
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QStringList>
+#include "samplebatch.hpp"
+#include "csvrecorder.hpp"
+
+#define CSV_CHUNK_BYTES      (4 * 1024 * 1024)                                            // Text parsed per job
+#define CSV_CHUNKS_AHEAD     64                                                           // Parsed chunks waiting at most
+
+/**
+ * @brief Loads a recorded CSV (one line per frame, one field per channel)
+ *
+ * The file is memory mapped and cut in line aligned chunks, parsed on all
+ * cores. Parsed chunks are handed out in file order with batchReady() as
+ * soon as they are available, so the data can be shown while the rest of
+ * the file is still being parsed. Workers never get more than
+ * CSV_CHUNKS_AHEAD chunks ahead of the ones handed out. The segments of
+ * a split recording are mapped together and read as one file. In
+ * compressed recordings every block is a chunk, uncompressed by the
+ * worker that parses it, and blocks outside the time range are skipped.
+ */
+class CsvImporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CsvImporter (QObject *parent = nullptr);
+    ~CsvImporter();
+
+    bool open (const QString &fileName);                                                  // Map the file and start parsing
+    /* Segments in recording order, of compressed ones only the blocks in [from, to] msecs */
+    bool open (const QStringList &fileNames, qint64 from = 0, qint64 to = Q_INT64_C (0x7fffffffffffffff));
+    qint64 firstFrame() const { return startFrame; }                                      // Of the first block loaded, -1 for plain CSV
+    void cancel();
+    QStringList header() const { return names; }                                          // Channel names if the file has a header line
+
+    /* Synchronous steps of the above, for callers that load on their own thread */
+    static const char *readHeader (const char *begin, const char *end, QStringList &names); // Returns where the frames start
+    static const char *chunkEnd (const char *begin, const char *end);                     // Line aligned, about CSV_CHUNK_BYTES
+    static void parse (const char *begin, const char *end, SampleBatch &batch);
+
+signals:
+    void batchReady (const SampleBatch &batch);
+    void progress (int percent);
+    void finished();
+
+private slots:
+    void poll();
+
+private:
+    struct Chunk
+    {
+        const char *begin;
+        const char *end;
+        bool packed;                                                                      // qCompress() output
+        SampleBatch batch;
+        QAtomicInt done;
+    };
+
+    QList<QFile*> files;                                                                  // Mapped for the whole load
+    QVector<Chunk> chunks;
+    QStringList names;
+    qint64 startFrame;
+    QThreadPool pool;
+    QTimer pollTimer;
+    QAtomicInt nextChunk;                                                                 // Next chunk a worker takes
+    QAtomicInt delivered;                                                                 // Chunks handed out so far
+    QAtomicInt canceled;
+
+    void work();
+};
+
+#endif // CSVIMPORTER_HPP
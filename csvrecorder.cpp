@@ -0,0 +1,673 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "csvrecorder.hpp"
+#include <QDateTime>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <QtNumeric>
+#include <QtEndian>
+#include <QDataStream>
+#include <cstdio>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define PACKED_HEADER_BYTES  44                                                           // Block header before the payload
+
+/**
+ * @brief Default: one plain file, synced when closed
+ */
+SegmentOptions::SegmentOptions() :
+  bytes (0),
+  seconds (0),
+  syncInterval (0),
+  compression (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse space separated options
+ *
+ * "off", "size:bytes" (k, M and G suffixes), "seconds:n", "minutes:n",
+ * "hours:n", "sync:ms" and "compress[:level]" (zlib 1..9, default 1).
+ * @param spec
+ * @param options Filled on success
+ * @param error Filled on failure
+ * @return
+ */
+bool SegmentOptions::parse (const QString &spec, SegmentOptions &options, QString *error)
+{
+    SegmentOptions parsed;
+    foreach (const QString &token, spec.split (' ', QString::SkipEmptyParts))
+      {
+        const QString name = token.section (':', 0, 0).toLower();
+        const QString value = token.section (':', 1);
+        bool ok = true;
+        if (name == "off" && value.isEmpty())
+          {
+            parsed = SegmentOptions();
+          }
+        else if (name == "size")
+          {
+            QString digits = value.toLower();
+            qint64 unit = 1;
+            if (digits.endsWith ('k'))
+              {
+                unit = 1024;
+              }
+            else if (digits.endsWith ('m'))
+              {
+                unit = 1024 * 1024;
+              }
+            else if (digits.endsWith ('g'))
+              {
+                unit = 1024 * 1024 * 1024;
+              }
+            if (unit > 1)
+              {
+                digits.chop (1);
+              }
+            parsed.bytes = digits.toLongLong (&ok) * unit;
+            ok = ok && parsed.bytes > 0;
+          }
+        else if (name == "seconds" || name == "minutes" || name == "hours")
+          {
+            parsed.seconds = value.toInt (&ok) * (name == "hours" ? 3600 : name == "minutes" ? 60 : 1);
+            ok = ok && parsed.seconds > 0;
+          }
+        else if (name == "sync")
+          {
+            parsed.syncInterval = value.toInt (&ok);
+            ok = ok && parsed.syncInterval >= 0;
+          }
+        else if (name == "compress")
+          {
+            parsed.compression = value.isEmpty() ? 1 : value.toInt (&ok);
+            ok = ok && parsed.compression >= 1 && parsed.compression <= 9;
+          }
+        else
+          {
+            ok = false;
+          }
+        if (!ok)
+          {
+            if (error != nullptr)
+              {
+                *error = "Bad segment option: " + token;
+              }
+            return false;
+          }
+      }
+    options = parsed;
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Spec that parse() turns back into the same options
+ * @return
+ */
+QString SegmentOptions::toString() const
+{
+    QStringList tokens;
+    if (bytes > 0)
+      {
+        tokens << QString ("size:%1").arg (bytes);
+      }
+    if (seconds > 0)
+      {
+        tokens << QString ("seconds:%1").arg (seconds);
+      }
+    if (syncInterval > 0)
+      {
+        tokens << QString ("sync:%1").arg (syncInterval);
+      }
+    if (compression > 0)
+      {
+        tokens << QString ("compress:%1").arg (compression);
+      }
+    return tokens.isEmpty() ? QString ("off") : tokens.join (' ');
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Flush a duplicated descriptor to disk and close it, on a pool thread
+ * @param handle
+ */
+static void syncHandle (int handle)
+{
+#ifdef Q_OS_UNIX
+    fsync (handle);
+    ::close (handle);
+#else
+    Q_UNUSED (handle);
+#endif
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Compress one block of CSV text, on a packer thread
+ * @param text
+ * @param level
+ * @return
+ */
+static QByteArray packText (const QByteArray &text, int level)
+{
+    return qCompress (text, level);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Decode a block header
+ * @param data Start of the file
+ * @param size
+ * @param position Of the header
+ * @param block Filled on success
+ * @return false if there is no complete block there
+ */
+static bool readBlockHeader (const char *data, qint64 size, qint64 position, PackedBlock &block)
+{
+    if (position < 8 || position + PACKED_HEADER_BYTES > size)
+      {
+        return false;
+      }
+    const uchar *p = reinterpret_cast<const uchar*> (data + position);
+    if (qFromLittleEndian<quint32> (p) != PACKED_BLOCK_MAGIC)
+      {
+        return false;
+      }
+    block.compressed = qFromLittleEndian<quint32> (p + 4) != 0;
+    block.rawSize = qFromLittleEndian<qint32> (p + 8);
+    block.packedSize = qFromLittleEndian<qint32> (p + 12);
+    block.firstFrame = qFromLittleEndian<qint64> (p + 16);
+    block.frames = qFromLittleEndian<qint32> (p + 24);
+    block.start = qFromLittleEndian<qint64> (p + 28);
+    block.end = qFromLittleEndian<qint64> (p + 36);
+    block.offset = position + PACKED_HEADER_BYTES;
+    return block.packedSize >= 0 && block.offset + block.packedSize <= size;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ */
+CsvRecorder::CsvRecorder() :
+  written (0),
+  closed (0),
+  stored (0)
+{
+    text.reserve (64 * 1024);                                                             // Kept by resize (0)
+    packers.setMaxThreadCount (PACKED_THREADS);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor
+ */
+CsvRecorder::~CsvRecorder()
+{
+    close();
+    syncing.waitForFinished();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Create (or truncate) the file, or its first segment
+ * @param fileName
+ * @return false if it cannot be written
+ */
+bool CsvRecorder::open (const QString &fileName)
+{
+    close();
+    written = 0;
+    closed = 0;
+    stored = 0;
+    segmentList.clear();
+    baseName = fileName;
+    if ((segmentOptions.enabled() || segmentOptions.compression > 0) && baseName.endsWith (".csv", Qt::CaseInsensitive))
+      {
+        baseName.chop (4);
+      }
+    return openSegment();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Start the next segment (or the only file), preallocated to the size limit
+ * @return false if it cannot be written
+ */
+bool CsvRecorder::openSegment()
+{
+    const bool packed = segmentOptions.compression > 0;
+    const QString suffix = packed ? PACKED_SUFFIX : ".csv";
+    SegmentInfo segment;
+    if (segmentOptions.enabled())
+      {
+        segment.fileName = QString ("%1-%2").arg (baseName).arg (segmentList.size() + 1, 4, 10, QChar ('0')) + suffix;
+      }
+    else
+      {
+        segment.fileName = packed ? baseName + suffix : baseName;
+      }
+    segment.firstFrame = segmentList.isEmpty() ? 0 : segmentList.last().firstFrame + segmentList.last().frames;
+    segment.frames = 0;
+    segment.start = QDateTime::currentMSecsSinceEpoch();
+    segment.end = segment.start;
+    segment.bytes = 0;
+
+    file.setFileName (segment.fileName);
+    if (!file.open (packed ? QIODevice::WriteOnly | QIODevice::Truncate : QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+      {
+        return false;
+      }
+    if (packed)
+      {
+        QDataStream out (&file);
+        out.setByteOrder (QDataStream::LittleEndian);
+        out << quint32 (PACKED_MAGIC) << quint32 (1);
+        blockOffsets.clear();
+        blockInfo.frames = 0;
+      }
+#ifdef Q_OS_LINUX
+    if (segmentOptions.bytes > 0)
+      {
+        fallocate (file.handle(), FALLOC_FL_KEEP_SIZE, 0, segmentOptions.bytes);          // Blocks reserved, the size stays what was written
+      }
+#endif
+    segmentList.append (segment);
+    syncClock.start();
+    if (segmentOptions.enabled())
+      {
+        writeIndex();
+      }
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Sync and close the current segment
+ */
+void CsvRecorder::closeSegment()
+{
+    if (segmentOptions.compression > 0)
+      {
+        submitBlock();
+        writeBlocks (true);
+
+        QDataStream out (&file);
+        out.setByteOrder (QDataStream::LittleEndian);
+        const qint64 indexOffset = file.pos();
+        out << qint32 (blockOffsets.size());
+        for (int i = 0; i < blockOffsets.size(); i++)
+          {
+            out << blockOffsets[i];
+          }
+        out << indexOffset << quint32 (PACKED_INDEX_MAGIC);
+      }
+    file.flush();
+    sync();
+    segmentList.last().bytes = file.size();
+    closed += file.size();
+    written = closed;
+    file.close();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Flush and close the file, if open
+ */
+void CsvRecorder::close()
+{
+    if (!file.isOpen())
+      {
+        return;
+      }
+    closeSegment();
+    if (segmentOptions.enabled())
+      {
+        writeIndex();
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Have the data written so far put on disk by a pool thread
+ *
+ * The descriptor is duplicated, so the file can be closed or rotated
+ * while the sync is still running.
+ */
+void CsvRecorder::sync()
+{
+    syncClock.start();
+#ifdef Q_OS_UNIX
+    const int handle = dup (file.handle());
+    if (handle >= 0)
+      {
+        syncing = QtConcurrent::run (syncHandle, handle);
+      }
+#endif
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Replace the index with the current segment list
+ *
+ * One line per segment: file, first frame, frames, first and last batch
+ * time (msecs since epoch) and bytes.
+ */
+void CsvRecorder::writeIndex()
+{
+    QSaveFile index (baseName + SEGMENT_INDEX_SUFFIX);
+    if (!index.open (QIODevice::WriteOnly | QIODevice::Text))
+      {
+        return;
+      }
+    QTextStream out (&index);
+    out << "file,first frame,frames,start,end,bytes\n";
+    for (int i = 0; i < segmentList.size(); i++)
+      {
+        const SegmentInfo &segment = segmentList[i];
+        out << QFileInfo (segment.fileName).fileName() << ',' << segment.firstFrame << ',' << segment.frames << ','
+            << segment.start << ',' << segment.end << ',' << segment.bytes << '\n';
+      }
+    out.flush();
+    index.commit();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Hand the filled block to a packer, or queue it as is when they are behind
+ */
+void CsvRecorder::submitBlock()
+{
+    if (blockInfo.frames == 0)
+      {
+        return;
+      }
+
+    Pending block;
+    block.block = blockInfo;
+    block.block.rawSize = blockText.size();
+    block.block.compressed = pending.size() < PACKED_IN_FLIGHT;
+    if (block.block.compressed)
+      {
+        block.packed = QtConcurrent::run (&packers, packText, blockText, segmentOptions.compression);
+      }
+    else
+      {
+        block.text = blockText;
+        stored++;
+      }
+    pending.append (block);
+
+    blockText = QByteArray();                                                             // The packer holds the old one
+    blockText.reserve (PACKED_BLOCK_BYTES + text.capacity());
+    blockInfo.frames = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Write the submitted blocks that are ready, in order
+ * @param wait Also wait for the ones still being compressed
+ */
+void CsvRecorder::writeBlocks (bool wait)
+{
+    QDataStream out (&file);
+    out.setByteOrder (QDataStream::LittleEndian);
+    while (!pending.isEmpty())
+      {
+        Pending &block = pending.first();
+        if (block.block.compressed && !wait && !block.packed.isFinished())
+          {
+            break;
+          }
+        const QByteArray payload = block.block.compressed ? block.packed.result() : block.text;
+        out << quint32 (PACKED_BLOCK_MAGIC) << quint32 (block.block.compressed) << qint32 (block.block.rawSize) << qint32 (payload.size())
+            << block.block.firstFrame << qint32 (block.block.frames) << block.block.start << block.block.end;
+        blockOffsets.append (file.pos());
+        file.write (payload);
+        pending.removeFirst();
+      }
+    file.flush();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Append the frames of a batch, starting a new segment first if the current one is full
+ * @param batch
+ */
+void CsvRecorder::write (const SampleBatch &batch)
+{
+    if (!file.isOpen())
+      {
+        return;
+      }
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (segmentOptions.enabled() && segmentList.last().frames > 0
+        && ((segmentOptions.bytes > 0 && segmentList.last().bytes >= segmentOptions.bytes)
+            || (segmentOptions.seconds > 0 && now - segmentList.last().start >= qint64 (segmentOptions.seconds) * 1000)))
+      {
+        closeSegment();
+        if (!openSegment())
+          {
+            return;                                                                       // fileName() tells which one failed
+          }
+      }
+
+    text.resize (0);
+    char number[32];
+    for (int f = 0; f < batch.frames; f++)
+      {
+        for (int c = 0; c < batch.channels.size(); c++)
+          {
+            if (batch.hasChannel (c) && !qIsNaN (batch.channels[c][f]))
+              {
+                /* As QTextStream did with precision 15, but printf follows the locale's decimal point */
+                const int length = qMin (qsnprintf (number, sizeof (number), "%.15g", batch.channels[c][f]), int (sizeof (number)) - 1);
+                for (int i = 0; i < length; i++)
+                  {
+                    if (number[i] == ',')
+                      {
+                        number[i] = '.';
+                      }
+                  }
+                text.append (number, length);
+              }
+            text.append (',');
+          }
+        text.append ('\n');
+      }
+    SegmentInfo &segment = segmentList.last();
+    if (segmentOptions.compression > 0)
+      {
+        if (blockInfo.frames == 0)
+          {
+            blockInfo.firstFrame = segment.firstFrame + segment.frames;
+            blockInfo.start = now;
+          }
+        blockInfo.frames += batch.frames;
+        blockInfo.end = now;
+        blockText.append (text);
+        if (blockText.size() >= PACKED_BLOCK_BYTES)
+          {
+            submitBlock();
+          }
+        writeBlocks (false);
+      }
+    else
+      {
+        file.write (text);
+        file.flush();                                                                     // Whole lines on disk after every read
+      }
+
+    segment.frames += batch.frames;
+    segment.end = now;
+    segment.bytes = file.size();
+    written = closed + segment.bytes;
+
+    if (segmentOptions.syncInterval > 0 && syncClock.elapsed() >= segmentOptions.syncInterval && syncing.isFinished())
+      {
+        if (segmentOptions.compression > 0)
+          {
+            submitBlock();                                                                // A partial block, to bound what a crash loses
+          }
+        sync();
+        if (segmentOptions.enabled())
+          {
+            writeIndex();
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Timestamped file name for a new recording
+ * @param tag Optional part telling apart simultaneous recordings
+ * @return
+ */
+QString CsvRecorder::defaultFileName (const QString &tag)
+{
+    QString name = QDateTime::currentDateTime().toString ("yyyy-MM-d-HH-mm-ss-");
+    if (!tag.isEmpty())
+      {
+        name += tag + "-";
+      }
+    return name + "data-out.csv";
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Read the segment list of a recording
+ * @param indexName
+ * @return Empty if the index cannot be read
+ */
+QVector<SegmentInfo> CsvRecorder::readIndex (const QString &indexName)
+{
+    QVector<SegmentInfo> segments;
+    QFile index (indexName);
+    if (!index.open (QIODevice::ReadOnly | QIODevice::Text))
+      {
+        return segments;
+      }
+    const QDir dir = QFileInfo (indexName).dir();
+    index.readLine();                                                                     // Header
+    while (!index.atEnd())
+      {
+        const QStringList fields = QString::fromUtf8 (index.readLine()).trimmed().split (',');
+        if (fields.size() < 6)
+          {
+            continue;
+          }
+        SegmentInfo segment;
+        segment.fileName = dir.filePath (fields[0]);
+        segment.firstFrame = fields[1].toLongLong();
+        segment.frames = fields[2].toLongLong();
+        segment.start = fields[3].toLongLong();
+        segment.end = fields[4].toLongLong();
+        segment.bytes = fields[5].toLongLong();
+        segments.append (segment);
+      }
+    return segments;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Blocks of a mapped compressed recording
+ *
+ * The index at the end is used when it is intact, otherwise the block
+ * headers are followed from the start, up to the last complete block.
+ * @param data
+ * @param size
+ * @return In file order, empty if this is not a compressed recording
+ */
+QVector<PackedBlock> CsvRecorder::readBlocks (const char *data, qint64 size)
+{
+    QVector<PackedBlock> blocks;
+    if (size < 8 || qFromLittleEndian<quint32> (reinterpret_cast<const uchar*> (data)) != PACKED_MAGIC)
+      {
+        return blocks;
+      }
+
+    PackedBlock block;
+    if (size >= 8 + 16 && qFromLittleEndian<quint32> (reinterpret_cast<const uchar*> (data + size - 4)) == PACKED_INDEX_MAGIC)
+      {
+        const qint64 indexOffset = qFromLittleEndian<qint64> (reinterpret_cast<const uchar*> (data + size - 12));
+        const qint32 count = indexOffset >= 8 && indexOffset + 4 <= size - 12 ? qFromLittleEndian<qint32> (reinterpret_cast<const uchar*> (data + indexOffset)) : -1;
+        if (count >= 0 && indexOffset + 4 + qint64 (count) * 8 == size - 12)
+          {
+            for (int i = 0; i < count; i++)
+              {
+                const qint64 offset = qFromLittleEndian<qint64> (reinterpret_cast<const uchar*> (data + indexOffset + 4 + qint64 (i) * 8));
+                if (!readBlockHeader (data, size, offset - PACKED_HEADER_BYTES, block))
+                  {
+                    blocks.clear();
+                    break;
+                  }
+                blocks.append (block);
+              }
+            if (blocks.size() == count)
+              {
+                return blocks;
+              }
+          }
+      }
+
+    qint64 position = 8;
+    while (readBlockHeader (data, size, position, block))
+      {
+        blocks.append (block);
+        position = block.offset + block.packedSize;
+      }
+    return blocks;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Blocks of a compressed recording file
+ * @param fileName
+ * @return Empty if it cannot be read or is not one
+ */
+QVector<PackedBlock> CsvRecorder::readBlocks (const QString &fileName)
+{
+    QFile file (fileName);
+    if (!file.open (QIODevice::ReadOnly) || file.size() == 0)
+      {
+        return QVector<PackedBlock>();
+      }
+    const uchar *data = file.map (0, file.size());
+    if (data == nullptr)
+      {
+        return QVector<PackedBlock>();
+      }
+    return readBlocks (reinterpret_cast<const char*> (data), file.size());                // Unmapped when the file closes
+}
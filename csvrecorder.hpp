@@ -0,0 +1,180 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef CSVRECORDER_HPP
+#define CSVRECORDER_HPP
+
+#include <QFile>
+#include <QByteArray>
+#include <QVector>
+#include <QFuture>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QList>
+#include "samplebatch.hpp"
+
+#define SEGMENT_INDEX_SUFFIX ".index"                                                     // Next to the segments, lists them
+#define PACKED_SUFFIX        ".csvz"                                                      // Compressed recording
+#define PACKED_MAGIC         0x5a505053                                                   // "SPPZ", file header
+#define PACKED_BLOCK_MAGIC   0x42505053                                                   // "SPPB", before every block
+#define PACKED_INDEX_MAGIC   0x49505053                                                   // "SPPI", ends the file
+#define PACKED_BLOCK_BYTES   (1024 * 1024)                                                // CSV text per block
+#define PACKED_THREADS       2                                                            // Compression workers per recorder
+#define PACKED_IN_FLIGHT     8                                                            // Blocks queued past this are stored
+
+/**
+ * @brief How a recording is split, synced and compressed, given as a spec such as "size:256M minutes:60 sync:1000 compress:1"
+ */
+struct SegmentOptions
+{
+    qint64 bytes;                                                                         // Segment size limit, preallocated; 0 none
+    int seconds;                                                                          // Segment duration limit, 0 none
+    int syncInterval;                                                                     // ms between background fsyncs, 0 never
+    int compression;                                                                      // zlib level 1..9 for PACKED_SUFFIX files, 0 plain CSV
+
+    SegmentOptions();
+
+    bool enabled() const { return bytes > 0 || seconds > 0; }
+    static bool parse (const QString &spec, SegmentOptions &options, QString *error);
+    QString toString() const;
+};
+
+/**
+ * @brief One segment of a recording, as listed in its index
+ */
+struct SegmentInfo
+{
+    QString fileName;
+    qint64 firstFrame;                                                                    // Frames before it in the recording
+    qint64 frames;
+    qint64 start;                                                                         // msecs since epoch of its first and last batch
+    qint64 end;
+    qint64 bytes;
+};
+
+/**
+ * @brief One block of a compressed recording
+ */
+struct PackedBlock
+{
+    qint64 offset;                                                                        // Of the payload in the file
+    qint32 packedSize;
+    qint32 rawSize;
+    bool compressed;                                                                      // qCompress() output, or the CSV text as is
+    qint64 firstFrame;
+    qint32 frames;
+    qint64 start;                                                                         // msecs since epoch of its first and last batch
+    qint64 end;
+};
+
+/**
+ * @brief Writes batches to a CSV file, one line per frame and one field per column
+ *
+ * Missing values are left empty and every field is followed by ',', which is
+ * what CsvImporter reads back. Lines are formatted into a reused buffer,
+ * so recording does not allocate per batch.
+ *
+ * With segment limits set, "name.csv" is recorded as "name-0001.csv",
+ * "name-0002.csv"... started at batch boundaries, each preallocated to the
+ * size limit (Linux), and "name.index" lists every segment's frame and
+ * time range. The index is rewritten at every sync, so after a crash it
+ * still tells which segment holds what. Syncs run on the thread pool.
+ *
+ * With compression the CSV text is cut in blocks of PACKED_BLOCK_BYTES
+ * (or less at a sync), each qCompress()ed on its own by a small worker
+ * pool and written in order once done. A block that would queue behind
+ * PACKED_IN_FLIGHT others is stored as is, so compression never holds up
+ * ingest. Every block has a header with its frame and time range and the
+ * file ends with an index of them, for random access by time; without
+ * the index (crash) the headers are scanned. All numbers little endian:
+ *   file:  magic, version (quint32)
+ *   block: magic, compressed (quint32), raw size, packed size (qint32),
+ *          first frame (qint64), frames (qint32), start, end (qint64), payload
+ *   index: count (qint32), payload offset (qint64) per block, index offset (qint64), magic
+ */
+class CsvRecorder
+{
+public:
+    CsvRecorder();
+    ~CsvRecorder();
+
+    void setSegments (const SegmentOptions &options) { segmentOptions = options; }        // Before open()
+    const SegmentOptions &segments() const { return segmentOptions; }
+
+    bool open (const QString &fileName);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+    QString fileName() const { return file.fileName(); }                                  // Current segment
+    qint64 bytes() const { return written; }
+    int segmentCount() const { return segmentList.size(); }
+    qint64 storedBlocks() const { return stored; }                                        // Written uncompressed to keep up
+
+    void write (const SampleBatch &batch);
+
+    /* "yyyy-MM-d-HH-mm-ss-[tag-]data-out.csv" in the working directory */
+    static QString defaultFileName (const QString &tag = QString());
+
+    /* Segments listed by an index file, with their paths made absolute */
+    static QVector<SegmentInfo> readIndex (const QString &indexName);
+
+    /* Blocks of a compressed recording, from its index or by scanning; empty if not one */
+    static QVector<PackedBlock> readBlocks (const char *data, qint64 size);
+    static QVector<PackedBlock> readBlocks (const QString &fileName);
+
+private:
+    QFile file;
+    QByteArray text;                                                                      // Lines of the batch being written
+    qint64 written;                                                                       // All segments
+    qint64 closed;                                                                        // Segments done with
+    SegmentOptions segmentOptions;
+    QString baseName;                                                                     // Without ".csv" when segmenting
+    QVector<SegmentInfo> segmentList;
+    QElapsedTimer syncClock;
+    QFuture<void> syncing;
+
+    struct Pending
+    {
+        PackedBlock block;
+        QByteArray text;                                                                  // Stored blocks
+        QFuture<QByteArray> packed;                                                       // Compressed ones
+    };
+
+    QByteArray blockText;                                                                 // CSV of the block being filled
+    PackedBlock blockInfo;
+    QList<Pending> pending;                                                               // Submitted, in file order
+    QVector<qint64> blockOffsets;                                                         // Of the segment's written blocks
+    QThreadPool packers;
+    qint64 stored;                                                                        // Blocks not compressed to keep up
+
+    bool openSegment();
+    void closeSegment();
+    void sync();
+    void writeIndex();
+    void submitBlock();
+    void writeBlocks (bool wait);
+};
+
+#endif // CSVRECORDER_HPP
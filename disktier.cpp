@@ -0,0 +1,221 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "disktier.hpp"
+#include <QDir>
+
+/**
+ * @brief Constructor, creates the session directory
+ */
+DiskTier::DiskTier() :
+    mDirectory (QDir::tempPath() + "/serial_port_plotter-XXXXXX"),
+    mSegments (0),
+    mCurrent (new DiskSegments),
+    mBytes (0),
+    mSegmentStart (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor, segment files go away with the session directory
+ */
+DiskTier::~DiskTier()
+{
+    clear();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor, removes the segment files
+ */
+DiskSegments::~DiskSegments()
+{
+    for (int i = 0; i < paths.size(); i++)
+      {
+        QFile::remove (paths[i]);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief File name of a segment
+ * @param segment
+ */
+QString DiskTier::segmentPath (int segment) const
+{
+    return mDirectory.path() + QString ("/segment-%1.bin").arg (segment, 5, 10, QChar ('0'));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Append data to the current segment
+ * @param data
+ * @param segment Where it was written
+ * @param offset
+ * @return false if the session directory or the write failed
+ */
+bool DiskTier::write (const QByteArray &data, int &segment, qint64 &offset)
+{
+    if (!mDirectory.isValid())
+      {
+        return false;
+      }
+
+    if (!mWriter.isOpen() || mWriter.size() + data.size() > DISK_SEGMENT_BYTES)
+      {
+        mWriter.close();
+        mWriter.setFileName (segmentPath (mSegments));
+        if (!mWriter.open (QIODevice::WriteOnly))
+          {
+            return false;
+          }
+        mCurrent->paths.append (mWriter.fileName());
+        mSegments++;
+        mSegmentStart = mBytes;
+      }
+
+    segment = mSegments - 1;
+    offset = mWriter.pos();
+    if (mWriter.write (data) != data.size() || !mWriter.flush())                          // Flushed to be visible to new mappings
+      {
+        mWriter.resize (offset);                                                          // No partial column before the next one
+        mWriter.seek (offset);
+        return false;
+      }
+    mBytes += data.size();
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Take back what was written since bytes() returned 'bytes'
+ *
+ * For a group of columns that could only be written in part. The current
+ * segment is cut back; a segment the writes filled up before it keeps their
+ * data until clear(), it is just no longer counted.
+ * @param bytes
+ */
+void DiskTier::rollback (qint64 bytes)
+{
+    QMutexLocker locker (&mReadLock);                                                     // A render thread may be reading
+    if (mWriter.isOpen())
+      {
+        for (int i = 0; i < mMapped.size(); i++)
+          {
+            if (mMapped[i].segment == mSegments - 1)
+              {
+                unmap (i);                                                                // Would reach past the end
+                break;
+              }
+          }
+        const qint64 keep = qMax<qint64> (0, bytes - mSegmentStart);
+        mWriter.resize (keep);
+        mWriter.seek (keep);
+        mSegmentStart = bytes - keep;
+      }
+    mBytes = bytes;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Pointer to data written before, mapping its segment if needed
+ * @param segment
+ * @param offset
+ * @param size
+ * @return nullptr if the segment cannot be mapped
+ */
+const char *DiskTier::map (int segment, qint64 offset, qint64 size)
+{
+    for (int i = 0; i < mMapped.size(); i++)
+      {
+        if (mMapped[i].segment != segment)
+          {
+            continue;
+          }
+        if (offset + size <= mMapped[i].size)
+          {
+            mMapped.move (i, 0);
+            return reinterpret_cast<const char*> (mMapped.first().data) + offset;
+          }
+        unmap (i);                                                                        // Mapped before it grew
+        break;
+      }
+
+    Mapping mapping;
+    mapping.segment = segment;
+    mapping.file = new QFile (segmentPath (segment));
+    mapping.data = nullptr;
+    if (mapping.file->open (QIODevice::ReadOnly))
+      {
+        mapping.size = mapping.file->size();
+        mapping.data = mapping.file->map (0, mapping.size);
+      }
+    if (mapping.data == nullptr || offset + size > mapping.size)
+      {
+        delete mapping.file;
+        return nullptr;
+      }
+
+    mMapped.prepend (mapping);
+    while (mMapped.size() > DISK_MAPPED_SEGMENTS)
+      {
+        unmap (mMapped.size() - 1);
+      }
+    return reinterpret_cast<const char*> (mapping.data) + offset;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Drop a mapping
+ * @param index In mMapped
+ */
+void DiskTier::unmap (int index)
+{
+    mMapped[index].file->unmap (mMapped[index].data);
+    delete mMapped[index].file;
+    mMapped.removeAt (index);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Unmap every segment and start new ones
+ *
+ * Snapshots published before the clear may still hold spilled columns, so
+ * the old segments are only removed once the last of them is released;
+ * new columns get new segment numbers and never map an old file.
+ */
+void DiskTier::clear()
+{
+    QMutexLocker locker (&mReadLock);                                                     // A render thread may be reading
+    while (!mMapped.isEmpty())
+      {
+        unmap (0);
+      }
+    mWriter.close();
+    mCurrent = QSharedPointer<DiskSegments> (new DiskSegments);
+    mBytes = 0;
+}
@@ -0,0 +1,99 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef DISKTIER_HPP
+#define DISKTIER_HPP
+
+#include <QFile>
+#include <QList>
+#include <QTemporaryDir>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QStringList>
+
+#define DISK_SEGMENT_BYTES    (64 * 1024 * 1024)                                          // Segment file size before starting a new one
+#define DISK_MAPPED_SEGMENTS  8                                                           // Segments kept mapped
+
+/**
+ * @brief Segment files written between two DiskTier::clear() calls
+ *
+ * Spilled columns hold a reference, so a snapshot taken before a clear can
+ * still read its columns; the files go with the last reference.
+ */
+class DiskSegments
+{
+public:
+    ~DiskSegments();
+
+    QStringList paths;                                                                    // Only appended to while current
+};
+
+/**
+ * @brief Scrollback files for history blocks evicted from memory
+ *
+ * Column data is appended to segment files in a session directory that is
+ * removed on exit. Reading maps a whole segment and keeps the most recently
+ * used ones mapped, so browsing old history pages it in through the OS.
+ * Segment numbers are never reused, not even after clear().
+ */
+class DiskTier
+{
+public:
+    DiskTier();
+    ~DiskTier();
+
+    bool isValid() const { return mDirectory.isValid(); }
+    qint64 bytes() const { return mBytes; }
+    bool write (const QByteArray &data, int &segment, qint64 &offset);
+    void rollback (qint64 bytes);                                                         // Take back the writes since bytes() was this
+    QSharedPointer<DiskSegments> segments() const { return mCurrent; }                    // Keeps what write() returned readable
+    const char *map (int segment, qint64 offset, qint64 size);                            // Valid until the next map()
+    QMutex *readLock() { return &mReadLock; }                                             // Held from map() to the end of the read by concurrent readers, and by clear()
+    void clear();                                                                         // Start new segments, the old ones go once unreferenced
+
+private:
+    struct Mapping
+    {
+        int segment;
+        QFile *file;
+        uchar *data;
+        qint64 size;
+    };
+
+    QTemporaryDir mDirectory;
+    QFile mWriter;                                                                        // Segment being appended
+    int mSegments;                                                                        // Segments ever started
+    QSharedPointer<DiskSegments> mCurrent;
+    qint64 mBytes;
+    qint64 mSegmentStart;                                                                 // mBytes when the current segment was started
+    QList<Mapping> mMapped;                                                               // Most recently used first
+    QMutex mReadLock;
+
+    QString segmentPath (int segment) const;
+    void unmap (int index);
+};
+
+#endif // DISKTIER_HPP
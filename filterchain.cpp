@@ -0,0 +1,374 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "filterchain.hpp"
+#include <QtMath>
+#include <QtNumeric>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FILTER_SSE2
+#endif
+
+/**
+ * @brief Constructor
+ * @param length Number of samples averaged
+ */
+MovingAverageFilter::MovingAverageFilter (int length) :
+  pos (0),
+  filled (0),
+  sum (0)
+{
+    history.fill (0, qMax (length, 1));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int MovingAverageFilter::process (double *data, int *positions, int count)
+{
+    Q_UNUSED (positions)
+    const int length = history.size();
+    double *h = history.data();
+
+    for (int i = 0; i < count; i++)
+      {
+        const double x = data[i];
+        sum += x - h[pos];
+        h[pos] = x;
+        if (++pos == length)
+          {
+            /* Resum once per lap so rounding errors do not accumulate */
+            pos = 0;
+            sum = 0;
+            for (int k = 0; k < length; k++)
+              {
+                sum += h[k];
+              }
+          }
+        if (filled < length)
+          {
+            filled++;
+          }
+        data[i] = sum / filled;
+      }
+    return count;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void MovingAverageFilter::reset()
+{
+    history.fill (0);
+    pos = 0;
+    filled = 0;
+    sum = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor, coefficients already normalized (a0 = 1)
+ */
+BiquadFilter::BiquadFilter (double b0, double b1, double b2, double a1, double a2) :
+  b0 (b0), b1 (b1), b2 (b2), a1 (a1), a2 (a2),
+  z1 (0), z2 (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief RBJ cookbook low pass
+ * @param frequency Cutoff in cycles/sample
+ * @param q
+ */
+BiquadFilter *BiquadFilter::lowPass (double frequency, double q)
+{
+    const double w0 = 2.0 * M_PI * frequency;
+    const double alpha = qSin (w0) / (2.0 * q);
+    const double c = qCos (w0);
+    const double a0 = 1.0 + alpha;
+    return new BiquadFilter ((1.0 - c) / 2.0 / a0, (1.0 - c) / a0, (1.0 - c) / 2.0 / a0,
+                             -2.0 * c / a0, (1.0 - alpha) / a0);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief RBJ cookbook high pass
+ * @param frequency Cutoff in cycles/sample
+ * @param q
+ */
+BiquadFilter *BiquadFilter::highPass (double frequency, double q)
+{
+    const double w0 = 2.0 * M_PI * frequency;
+    const double alpha = qSin (w0) / (2.0 * q);
+    const double c = qCos (w0);
+    const double a0 = 1.0 + alpha;
+    return new BiquadFilter ((1.0 + c) / 2.0 / a0, -(1.0 + c) / a0, (1.0 + c) / 2.0 / a0,
+                             -2.0 * c / a0, (1.0 - alpha) / a0);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int BiquadFilter::process (double *data, int *positions, int count)
+{
+    Q_UNUSED (positions)
+    /* State in locals so the recursion stays in registers */
+    double s1 = z1;
+    double s2 = z2;
+
+    for (int i = 0; i < count; i++)
+      {
+        const double x = data[i];
+        const double y = b0 * x + s1;
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+        data[i] = y;
+      }
+
+    z1 = s1;
+    z2 = s2;
+    return count;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void BiquadFilter::reset()
+{
+    z1 = 0;
+    z2 = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ * @param taps h[0] applies to the newest sample
+ */
+FirFilter::FirFilter (const QVector<double> &taps)
+{
+    for (int i = taps.size() - 1; i >= 0; i--)
+      {
+        reversedTaps.append (taps[i]);
+      }
+    buffer.fill (0, reversedTaps.size() - 1);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int FirFilter::process (double *data, int *positions, int count)
+{
+    Q_UNUSED (positions)
+    const int taps = reversedTaps.size();
+    const int history = taps - 1;
+    const double *h = reversedTaps.constData();
+
+    buffer.resize (history + count);
+    double *x = buffer.data();
+    memcpy (x + history, data, size_t (count) * sizeof (double));
+
+    for (int i = 0; i < count; i++)
+      {
+        const double *window = x + i;
+        double acc = 0;
+        int k = 0;
+#ifdef FILTER_SSE2
+        __m128d sum = _mm_setzero_pd();
+        for (; k + 2 <= taps; k += 2)
+          {
+            sum = _mm_add_pd (sum, _mm_mul_pd (_mm_loadu_pd (h + k), _mm_loadu_pd (window + k)));
+          }
+        double lanes[2];
+        _mm_storeu_pd (lanes, sum);
+        acc = lanes[0] + lanes[1];
+#endif
+        for (; k < taps; k++)
+          {
+            acc += h[k] * window[k];
+          }
+        data[i] = acc;
+      }
+
+    /* Keep the newest inputs as history for the next batch */
+    memmove (x, x + count, size_t (history) * sizeof (double));
+    buffer.resize (history);
+    return count;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void FirFilter::reset()
+{
+    buffer.fill (0, reversedTaps.size() - 1);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ * @param factor
+ */
+DecimateFilter::DecimateFilter (int factor) :
+  factor (qMax (factor, 1)),
+  phase (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int DecimateFilter::process (double *data, int *positions, int count)
+{
+    int out = 0;
+    for (int i = 0; i < count; i++)
+      {
+        if (++phase >= factor)
+          {
+            phase = 0;
+            data[out] = data[i];
+            positions[out] = positions[i];
+            out++;
+          }
+      }
+    return out;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void DecimateFilter::reset()
+{
+    phase = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Build the stages from a spec; the chain is unchanged on error
+ * @param spec See class description, empty removes all stages
+ * @param error Optional, filled with a description of the problem
+ * @return true on success
+ */
+bool FilterChain::parse (const QString &spec, QString *error)
+{
+    QList<QSharedPointer<StreamFilter> > parsed;
+
+    foreach (const QString &stage, spec.split ('|', QString::SkipEmptyParts))
+      {
+        if (stage.trimmed().isEmpty())
+          {
+            continue;
+          }
+
+        const QString name = stage.section (':', 0, 0).trimmed().toLower();
+        QVector<double> args;
+        foreach (const QString &arg, stage.section (':', 1).split (',', QString::SkipEmptyParts))
+          {
+            bool ok;
+            args.append (arg.trimmed().toDouble (&ok));
+            if (!ok)
+              {
+                if (error != nullptr)
+                  {
+                    *error = QString ("Bad number '%1' in '%2'").arg (arg.trimmed(), stage.trimmed());
+                  }
+                return false;
+              }
+          }
+
+        StreamFilter *filter = nullptr;
+        if (name == "ma" && args.size() == 1 && args[0] >= 1)
+          {
+            filter = new MovingAverageFilter (int (args[0]));
+          }
+        else if ((name == "lp" || name == "hp") && args.size() == 2 && args[0] > 0 && args[0] < 0.5 && args[1] > 0)
+          {
+            filter = (name == "lp") ? BiquadFilter::lowPass (args[0], args[1]) : BiquadFilter::highPass (args[0], args[1]);
+          }
+        else if (name == "biquad" && args.size() == 5)
+          {
+            filter = new BiquadFilter (args[0], args[1], args[2], args[3], args[4]);
+          }
+        else if (name == "fir" && !args.isEmpty())
+          {
+            filter = new FirFilter (args);
+          }
+        else if (name == "dec" && args.size() == 1 && args[0] >= 1)
+          {
+            filter = new DecimateFilter (int (args[0]));
+          }
+
+        if (filter == nullptr)
+          {
+            if (error != nullptr)
+              {
+                *error = QString ("Invalid filter stage '%1'").arg (stage.trimmed());
+              }
+            return false;
+          }
+        parsed.append (QSharedPointer<StreamFilter> (filter));
+      }
+
+    stages = parsed;
+    specText = spec.trimmed();
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Clear the state of every stage
+ */
+void FilterChain::reset()
+{
+    for (int i = 0; i < stages.size(); i++)
+      {
+        stages[i]->reset();
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Run one batch column through all stages
+ *
+ * NaN (missing) samples are skipped so they never enter the filter state.
+ * @param in Batch column
+ * @param out Same size as 'in', NaN where the chain produced no output
+ */
+void FilterChain::process (const QVector<double> &in, QVector<double> &out)
+{
+    const int frames = in.size();
+    int count = 0;
+
+    out.fill (qQNaN(), frames);
+    work.resize (frames);
+    positions.resize (frames);
+
+    for (int i = 0; i < frames; i++)
+      {
+        if (!qIsNaN (in[i]))
+          {
+            work[count] = in[i];
+            positions[count] = i;
+            count++;
+          }
+      }
+
+    for (int s = 0; s < stages.size() && count > 0; s++)
+      {
+        count = stages[s]->process (work.data(), positions.data(), count);
+      }
+
+    for (int i = 0; i < count; i++)
+      {
+        out[positions[i]] = work[i];
+      }
+}
@@ -0,0 +1,146 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef FILTERCHAIN_HPP
+#define FILTERCHAIN_HPP
+
+#include <QVector>
+#include <QList>
+#include <QString>
+#include <QSharedPointer>
+
+/**
+ * @brief One stage of a streaming filter chain
+ *
+ * Stages work in place on a dense batch of samples and keep their state
+ * between batches. 'positions' follows the samples so a stage that drops
+ * samples (decimation) can tell which input frame each output belongs to.
+ */
+class StreamFilter
+{
+public:
+    virtual ~StreamFilter() {}
+    virtual int process (double *data, int *positions, int count) = 0;                   // Returns samples left in 'data'
+    virtual void reset() = 0;
+};
+
+/**
+ * @brief Running mean over the last 'length' samples
+ */
+class MovingAverageFilter : public StreamFilter
+{
+public:
+    explicit MovingAverageFilter (int length);
+    int process (double *data, int *positions, int count) Q_DECL_OVERRIDE;
+    void reset() Q_DECL_OVERRIDE;
+
+private:
+    QVector<double> history;
+    int pos;
+    int filled;
+    double sum;
+};
+
+/**
+ * @brief Second order IIR section, transposed direct form II
+ */
+class BiquadFilter : public StreamFilter
+{
+public:
+    BiquadFilter (double b0, double b1, double b2, double a1, double a2);
+    static BiquadFilter *lowPass (double frequency, double q);                            // Frequency in cycles/sample
+    static BiquadFilter *highPass (double frequency, double q);
+    int process (double *data, int *positions, int count) Q_DECL_OVERRIDE;
+    void reset() Q_DECL_OVERRIDE;
+
+private:
+    double b0, b1, b2, a1, a2;
+    double z1, z2;
+};
+
+/**
+ * @brief FIR with user supplied taps
+ *
+ * The previous taps-1 inputs are kept in front of the batch so every output
+ * is one contiguous dot product, vectorized with SSE2 where available.
+ */
+class FirFilter : public StreamFilter
+{
+public:
+    explicit FirFilter (const QVector<double> &taps);
+    int process (double *data, int *positions, int count) Q_DECL_OVERRIDE;
+    void reset() Q_DECL_OVERRIDE;
+
+private:
+    QVector<double> reversedTaps;
+    QVector<double> buffer;                                                               // History followed by the batch
+};
+
+/**
+ * @brief Keep one sample out of 'factor'
+ */
+class DecimateFilter : public StreamFilter
+{
+public:
+    explicit DecimateFilter (int factor);
+    int process (double *data, int *positions, int count) Q_DECL_OVERRIDE;
+    void reset() Q_DECL_OVERRIDE;
+
+private:
+    int factor;
+    int phase;
+};
+
+/**
+ * @brief Per channel list of filter stages built from a text spec
+ *
+ * Spec: stages separated by '|', each "name:arg,arg,..."
+ *   ma:N             moving average of N samples
+ *   lp:F,Q / hp:F,Q  low/high pass biquad, F in cycles/sample (0..0.5)
+ *   biquad:b0,b1,b2,a1,a2
+ *   fir:t0,t1,...    FIR taps
+ *   dec:N            keep one sample out of N
+ * Example: "ma:4 | lp:0.05,0.707 | dec:10"
+ */
+class FilterChain
+{
+public:
+    bool parse (const QString &spec, QString *error = nullptr);
+    QString spec() const { return specText; }
+    bool isEmpty() const { return stages.isEmpty(); }
+    void reset();
+
+    /* Filter one batch column; 'out' gets the same size, NaN where there is no output */
+    void process (const QVector<double> &in, QVector<double> &out);
+
+private:
+    QList<QSharedPointer<StreamFilter> > stages;
+    QString specText;
+    QVector<double> work;
+    QVector<int> positions;
+};
+
+#endif // FILTERCHAIN_HPP
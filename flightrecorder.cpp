@@ -0,0 +1,625 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "flightrecorder.hpp"
+#include <QDateTime>
+#include <QDataStream>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QtNumeric>
+#include <cstring>
+
+/**
+ * @brief Copy 'count' items out of a ring, starting at absolute position 'start'
+ */
+template <typename T>
+static void readRing (const T *ring, int capacity, qint64 start, int count, T *out)
+{
+    const int at = int (start % capacity);
+    const int first = qMin (count, capacity - at);
+    memcpy (out, ring + at, first * sizeof (T));
+    memcpy (out + first, ring, (count - first) * sizeof (T));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Copy 'count' items into a ring, starting at absolute position 'start'
+ */
+template <typename T>
+static void writeRing (T *ring, int capacity, qint64 start, int count, const T *in)
+{
+    const int at = int (start % capacity);
+    const int first = qMin (count, capacity - at);
+    memcpy (ring + at, in, first * sizeof (T));
+    memcpy (ring, in + first, (count - first) * sizeof (T));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Move the items at positions [start, start + count) to a ring of another size
+ */
+template <typename T>
+static void moveRing (const T *ring, int capacity, T *grown, int grownCapacity, qint64 start, int count)
+{
+    for (qint64 p = start; p < start + count; p++)
+      {
+        grown[p % grownCapacity] = ring[p % capacity];
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Default: the last FLIGHT_SECONDS in at most FLIGHT_MEGABYTES, dumped on demand only
+ */
+FlightOptions::FlightOptions() :
+  seconds (FLIGHT_SECONDS),
+  megabytes (FLIGHT_MEGABYTES),
+  trigger (TriggerNone),
+  channel (0),
+  level (0.0),
+  after (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse space separated options
+ *
+ * "off", "seconds:n", "minutes:n", "megabytes:n", "above:channel:level",
+ * "below:channel:level", "text:string" and "after:seconds".
+ * @param spec
+ * @param options Filled on success
+ * @param error Filled on failure
+ * @return
+ */
+bool FlightOptions::parse (const QString &spec, FlightOptions &options, QString *error)
+{
+    FlightOptions parsed;
+    foreach (const QString &token, spec.split (' ', QString::SkipEmptyParts))
+      {
+        const QString name = token.section (':', 0, 0).toLower();
+        const QString value = token.section (':', 1);
+        bool ok = true;
+        if (name == "off" && value.isEmpty())
+          {
+            parsed.seconds = 0;
+          }
+        else if (name == "seconds" || name == "minutes")
+          {
+            parsed.seconds = value.toInt (&ok) * (name == "minutes" ? 60 : 1);
+            ok = ok && parsed.seconds > 0;
+          }
+        else if (name == "megabytes")
+          {
+            parsed.megabytes = value.toInt (&ok);
+            ok = ok && parsed.megabytes > 0;
+          }
+        else if (name == "above" || name == "below")
+          {
+            bool levelOk = false;
+            parsed.trigger = name == "above" ? TriggerAbove : TriggerBelow;
+            parsed.channel = value.section (':', 0, 0).toInt (&ok);
+            parsed.level = value.section (':', 1).toDouble (&levelOk);
+            ok = ok && levelOk && parsed.channel >= 0;
+          }
+        else if (name == "text" && !value.isEmpty())
+          {
+            parsed.trigger = TriggerText;
+            parsed.text = value.toUtf8();
+          }
+        else if (name == "after")
+          {
+            parsed.after = value.toInt (&ok);
+            ok = ok && parsed.after >= 0;
+          }
+        else
+          {
+            ok = false;
+          }
+        if (!ok)
+          {
+            if (error != nullptr)
+              {
+                *error = "Bad flight recorder option: " + token;
+              }
+            return false;
+          }
+      }
+    options = parsed;
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Spec that parse() turns back into the same options
+ * @return
+ */
+QString FlightOptions::toString() const
+{
+    if (seconds == 0)
+      {
+        return "off";
+      }
+    QStringList tokens;
+    tokens << QString ("seconds:%1").arg (seconds);
+    if (megabytes != FLIGHT_MEGABYTES)
+      {
+        tokens << QString ("megabytes:%1").arg (megabytes);
+      }
+    if (trigger == TriggerAbove || trigger == TriggerBelow)
+      {
+        tokens << QString ("%1:%2:%3").arg (trigger == TriggerAbove ? "above" : "below").arg (channel).arg (level);
+      }
+    else if (trigger == TriggerText)
+      {
+        tokens << "text:" + QString::fromUtf8 (text);
+      }
+    if (after > 0)
+      {
+        tokens << QString ("after:%1").arg (after);
+      }
+    return tokens.join (' ');
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ * @param parent
+ */
+FlightRecorder::FlightRecorder (QObject *parent) :
+  QObject (parent),
+  recordHead (0),
+  recordCount (0),
+  rawFirst (0),
+  rawEnd (0),
+  frameCapacity (0),
+  frameFirst (0),
+  frameEnd (0),
+  armed (true),
+  lastInside (false),
+  busy (0)
+{
+    afterTimer.setSingleShot (true);
+    connect (&afterTimer, SIGNAL (timeout()), this, SLOT (onAfter()));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Change span and trigger; a shorter span drops the excess at the next entry
+ *
+ * Turning the recorder off or changing its memory limit frees the rings,
+ * they grow again from their first size.
+ * @param newOptions
+ */
+void FlightRecorder::setOptions (const FlightOptions &newOptions)
+{
+    const bool release = newOptions.seconds == 0 || newOptions.megabytes != settings.megabytes;
+    settings = newOptions;
+    textTail.clear();
+    lastInside = false;
+    if (release)
+      {
+        clear();
+        records.clear();
+        rawRing = QByteArray();
+        frameRing.clear();
+        frameCapacity = 0;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Keep a received chunk, and look for the trigger text in it
+ * @param data
+ * @param size
+ */
+void FlightRecorder::addRaw (const char *data, int size)
+{
+    if (settings.seconds == 0 || size <= 0)
+      {
+        return;
+      }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    makeRoom (true, size, now);
+    writeRing (rawRing.data(), rawRing.size(), rawEnd, size, data);
+    const Record entry = {now, true, rawEnd, size, 0.0, 0};
+    rawEnd += size;
+    rawFirst = qMax (rawFirst, rawEnd - rawRing.size());
+    addRecord (entry);
+    trim (now);
+
+    if (settings.trigger == FlightOptions::TriggerText)
+      {
+        textTail.append (data, size);
+        if (textTail.contains (settings.text))
+          {
+            fire ("\"" + QString::fromUtf8 (settings.text) + "\" received");
+            textTail.clear();
+          }
+        else
+          {
+            textTail = textTail.right (settings.text.size() - 1);
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Keep a decoded batch, and check the level trigger on its channel
+ * @param firstKey Key of the batch's first frame
+ * @param batch
+ */
+void FlightRecorder::addBatch (double firstKey, const SampleBatch &batch)
+{
+    if (settings.seconds == 0 || batch.frames == 0)
+      {
+        return;
+      }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while (frameRing.size() < batch.channels.size())
+      {
+        frameRing.append (QVector<double> (frameCapacity, qQNaN()));                     // New channel, allocated once
+      }
+    makeRoom (false, batch.frames, now);
+    for (int c = 0; c < frameRing.size(); c++)
+      {
+        double *column = frameRing[c].data();
+        if (batch.hasChannel (c))
+          {
+            writeRing (column, frameCapacity, frameEnd, batch.frames, batch.channels[c].constData());
+            continue;
+          }
+        for (int f = 0; f < batch.frames; f++)
+          {
+            column[(frameEnd + f) % frameCapacity] = qQNaN();
+          }
+      }
+    const Record entry = {now, false, frameEnd, batch.frames, firstKey, batch.channels.size()};
+    frameEnd += batch.frames;
+    frameFirst = qMax (frameFirst, frameEnd - frameCapacity);
+    addRecord (entry);
+    trim (now);
+
+    if ((settings.trigger == FlightOptions::TriggerAbove || settings.trigger == FlightOptions::TriggerBelow)
+        && batch.hasChannel (settings.channel))
+      {
+        const QVector<double> &column = batch.channels[settings.channel];
+        for (int f = 0; f < batch.frames; f++)
+          {
+            if (qIsNaN (column[f]))
+              {
+                continue;
+              }
+            const bool inside = settings.trigger == FlightOptions::TriggerAbove ? column[f] > settings.level
+                                                                                : column[f] < settings.level;
+            if (inside && !lastInside)
+              {
+                fire (QString ("channel %1 %2 %3 at %4").arg (settings.channel)
+                                                        .arg (settings.trigger == FlightOptions::TriggerAbove ? "above" : "below")
+                                                        .arg (settings.level).arg (firstKey + f));
+              }
+            lastInside = inside;
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Oldest record of the raw or of the frame ring
+ *
+ * Records only leave from the front, so older records whose data the
+ * other ring overwrote may still be held; they are skipped.
+ * @param raw
+ * @return nullptr if that ring holds nothing
+ */
+const FlightRecorder::Record *FlightRecorder::oldest (bool raw) const
+{
+    for (int i = 0; i < recordCount; i++)
+      {
+        if (record (i).raw == raw && intact (record (i)))
+          {
+            return &record (i);
+          }
+      }
+    return nullptr;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Double a ring when 'size' more items would overwrite data younger than the span
+ *
+ * Past the memory limit the ring keeps its size and the oldest data is
+ * overwritten, unless a single chunk or batch would not fit at all.
+ * @param raw Byte ring or frame ring
+ * @param size Items about to be written
+ * @param now
+ */
+void FlightRecorder::makeRoom (bool raw, int size, qint64 now)
+{
+    const int capacity = raw ? rawRing.size() : frameCapacity;
+    const qint64 end = raw ? rawEnd : frameEnd;
+    const Record *first = oldest (raw);
+    const bool overwrites = first != nullptr && first->time >= now - qint64 (settings.seconds) * 1000
+                            && first->start < end + size - capacity;
+    if (capacity >= size && !overwrites)
+      {
+        return;
+      }
+
+    int grown = qMax (capacity * 2, raw ? FLIGHT_RAW_START : FLIGHT_FRAMES_START);
+    while (grown < size)
+      {
+        grown *= 2;
+      }
+    const qint64 unit = raw ? 1 : frameRing.size() * qint64 (sizeof (double));
+    if (capacity >= size && bytes() + (grown - capacity) * unit > qint64 (settings.megabytes) * 1024 * 1024)
+      {
+        return;
+      }
+
+    /* Every record from the oldest intact one on is in [first->start, end) */
+    const qint64 from = first != nullptr ? first->start : end;
+    if (raw)
+      {
+        QByteArray ring (grown, '\0');
+        moveRing (rawRing.constData(), capacity, ring.data(), grown, from, int (end - from));
+        rawRing = ring;
+        rawFirst = from;
+        return;
+      }
+    for (int c = 0; c < frameRing.size(); c++)
+      {
+        QVector<double> column (grown, qQNaN());
+        moveRing (frameRing[c].constData(), capacity, column.data(), grown, from, int (end - from));
+        frameRing[c] = column;
+      }
+    frameCapacity = grown;
+    frameFirst = from;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Append a record, doubling the record ring when it is full
+ * @param entry
+ */
+void FlightRecorder::addRecord (const Record &entry)
+{
+    if (recordCount == records.size())
+      {
+        QVector<Record> grown (qMax (64, records.size() * 2));
+        for (int i = 0; i < recordCount; i++)
+          {
+            grown[i] = record (i);
+          }
+        records = grown;
+        recordHead = 0;
+      }
+    records[(recordHead + recordCount) % records.size()] = entry;
+    recordCount++;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Drop the records older than the span or whose data was overwritten
+ * @param now
+ */
+void FlightRecorder::trim (qint64 now)
+{
+    const qint64 oldestTime = now - qint64 (settings.seconds) * 1000;
+    while (recordCount > 0)
+      {
+        const Record &first = record (0);
+        if (first.time >= oldestTime && intact (first))
+          {
+            break;
+          }
+        recordHead = (recordHead + 1) % records.size();
+        recordCount--;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Forget everything held, the rings keep their size
+ */
+void FlightRecorder::clear()
+{
+    recordHead = 0;
+    recordCount = 0;
+    rawFirst = 0;
+    rawEnd = 0;
+    frameFirst = 0;
+    frameEnd = 0;
+    textTail.clear();
+    lastInside = false;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Memory taken by the rings
+ * @return Bytes
+ */
+qint64 FlightRecorder::bytes() const
+{
+    return rawRing.size() + qint64 (frameCapacity) * frameRing.size() * qint64 (sizeof (double))
+           + qint64 (records.size()) * qint64 (sizeof (Record));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Span between the oldest and the newest entry
+ * @return Seconds
+ */
+int FlightRecorder::seconds() const
+{
+    if (recordCount == 0)
+      {
+        return 0;
+      }
+    return int ((record (recordCount - 1).time - record (0).time) / 1000);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Write what the ring holds now, in the background
+ * @param fileName
+ * @param names Channel names, by column index
+ * @return false when there is nothing to write
+ */
+bool FlightRecorder::dump (const QString &fileName, const QStringList &names)
+{
+    if (recordCount == 0)
+      {
+        armed = true;
+        return false;
+      }
+
+    Contents contents;
+    contents.records.reserve (recordCount);
+    for (int i = 0; i < recordCount; i++)
+      {
+        if (intact (record (i)))
+          {
+            contents.records.append (record (i));
+          }
+      }
+    contents.raw = rawRing;
+    contents.frames = frameRing;
+    contents.frameCapacity = frameCapacity;
+
+    busy++;
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool> (this);
+    watcher->setProperty ("fileName", fileName);
+    connect (watcher, SIGNAL (finished()), this, SLOT (onFinished()));
+    watcher->setFuture (QtConcurrent::run (write, fileName, names, contents));            // Shallow copy, capture goes on
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Timestamped file name for a dump
+ * @return
+ */
+QString FlightRecorder::defaultFileName()
+{
+    return QDateTime::currentDateTime().toString ("yyyy-MM-d-HH-mm-ss-") + "flight.sppf";
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief The trigger condition was met; report it now or once the post trigger span is recorded
+ * @param why
+ */
+void FlightRecorder::fire (const QString &why)
+{
+    if (!armed)
+      {
+        return;
+      }
+    armed = false;
+    reason = why;
+    if (settings.after > 0)
+      {
+        afterTimer.start (settings.after * 1000);
+        return;
+      }
+    emit triggered (reason);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief The post trigger span is recorded
+ */
+void FlightRecorder::onAfter()
+{
+    emit triggered (reason);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief A dump is written, the trigger may fire again
+ */
+void FlightRecorder::onFinished()
+{
+    QFutureWatcher<bool> *watcher = static_cast<QFutureWatcher<bool>*> (sender());
+    busy--;
+    armed = true;
+    emit dumped (watcher->property ("fileName").toString(), watcher->result());
+    watcher->deleteLater();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Write the records to a file, on a pool thread
+ * @param fileName
+ * @param names
+ * @param contents
+ * @return false if the file could not be written
+ */
+bool FlightRecorder::write (const QString &fileName, const QStringList &names, const Contents &contents)
+{
+    QFile file (fileName);
+    if (!file.open (QIODevice::WriteOnly | QIODevice::Truncate))
+      {
+        return false;
+      }
+
+    QDataStream out (&file);
+    out.setVersion (QDataStream::Qt_5_0);
+    out.setByteOrder (QDataStream::LittleEndian);
+    out.setFloatingPointPrecision (QDataStream::DoublePrecision);
+    out << quint32 (FLIGHT_MAGIC) << quint32 (FLIGHT_VERSION) << names;
+
+    QByteArray raw;
+    for (int i = 0; i < contents.records.size(); i++)
+      {
+        const Record &entry = contents.records[i];
+        if (entry.raw)
+          {
+            raw.resize (entry.size);
+            readRing (contents.raw.constData(), contents.raw.size(), entry.start, entry.size, raw.data());
+            out << quint8 (1) << entry.time << raw;
+            continue;
+          }
+
+        out << quint8 (2) << entry.time << entry.firstKey << qint32 (entry.size) << qint32 (entry.channels);
+        for (int c = 0; c < entry.channels; c++)
+          {
+            const bool present = c < contents.frames.size();
+            out << quint8 (present);
+            for (int f = 0; present && f < entry.size; f++)
+              {
+                out << contents.frames[c][(entry.start + f) % contents.frameCapacity];
+              }
+          }
+      }
+
+    file.close();
+    return out.status() == QDataStream::Ok && file.error() == QFileDevice::NoError;
+}
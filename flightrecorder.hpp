@@ -0,0 +1,170 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef FLIGHTRECORDER_HPP
+#define FLIGHTRECORDER_HPP
+
+#include <QObject>
+#include <QVector>
+#include <QTimer>
+#include <QStringList>
+#include <QByteArray>
+#include "samplebatch.hpp"
+
+#define FLIGHT_SECONDS       300                                                          // Default span kept in RAM
+#define FLIGHT_MEGABYTES     64                                                           // Default memory limit of the rings
+#define FLIGHT_RAW_START     (64 * 1024)                                                  // First size of the raw byte ring
+#define FLIGHT_FRAMES_START  4096                                                         // First size of the frame ring
+#define FLIGHT_MAGIC         0x46505053                                                   // "SPPF"
+#define FLIGHT_VERSION       1
+
+/**
+ * @brief When the flight recorder dumps on its own, given as a spec such as "minutes:5 megabytes:32 above:0:1000 after:10"
+ */
+struct FlightOptions
+{
+    enum Trigger
+    {
+        TriggerNone,
+        TriggerAbove,                                                                     // Channel rises above level
+        TriggerBelow,                                                                     // Channel falls below level
+        TriggerText                                                                       // Received bytes contain text
+    };
+
+    int seconds;                                                                          // Span kept, 0 disables the recorder
+    int megabytes;                                                                        // Memory the rings may grow to
+    Trigger trigger;
+    int channel;
+    double level;
+    QByteArray text;
+    int after;                                                                            // Seconds recorded past the trigger before dumping
+
+    FlightOptions();
+
+    static bool parse (const QString &spec, FlightOptions &options, QString *error);
+    QString toString() const;
+};
+
+/**
+ * @brief Always-on RAM ring of the last minutes of raw bytes and decoded frames
+ *
+ * Received chunks are copied into a byte ring and batches into a frame ring
+ * with one column per channel; a record stamped with the wall clock tells
+ * where each one went. The rings start small and double while they would
+ * overwrite data younger than the span, up to the megabytes option, so
+ * once they fit the data rate nothing is allocated any more; past the limit
+ * the span shrinks instead. Records whose data was overwritten are dropped.
+ *
+ * dump() takes a shallow copy of the rings and writes it on the thread
+ * pool, so capture goes on while the file is written; the next write to a
+ * ring then copies it once. A trigger fires once on an edge; it is armed
+ * again when the dump it caused is written.
+ *
+ * File layout (QDataStream, little endian): magic, version, channel names
+ * (QStringList), then records until the end: quint8 type, qint64 msecs
+ * since epoch, and for type 1 the raw bytes (QByteArray), for type 2 the
+ * first key (double), the frame and channel counts (qint32) and per
+ * channel a quint8 present flag followed by that many doubles.
+ */
+class FlightRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FlightRecorder (QObject *parent = nullptr);
+
+    void setOptions (const FlightOptions &newOptions);
+    const FlightOptions &options() const { return settings; }
+
+    void addRaw (const char *data, int size);
+    void addBatch (double firstKey, const SampleBatch &batch);
+    void clear();
+
+    bool dump (const QString &fileName, const QStringList &names);                        // false when the ring is empty
+    int pending() const { return busy; }
+    qint64 bytes() const;                                                                 // Memory taken by the rings
+    int seconds() const;                                                                  // Span actually held
+
+    /* "yyyy-MM-d-HH-mm-ss-flight.sppf" in the working directory */
+    static QString defaultFileName();
+
+signals:
+    void triggered (const QString &reason);                                               // Time to dump, after the post trigger span
+    void dumped (const QString &fileName, bool ok);
+
+private slots:
+    void onAfter();
+    void onFinished();
+
+private:
+    struct Record
+    {
+        qint64 time;                                                                      // msecs since epoch
+        bool raw;                                                                         // Raw bytes or frames
+        qint64 start;                                                                     // Position in its ring, counted since clear()
+        int size;                                                                         // Bytes or frames
+        double firstKey;                                                                  // Frames only
+        int channels;
+    };
+
+    /* What dump() hands to the writer, rings shared until the next write */
+    struct Contents
+    {
+        QVector<Record> records;                                                          // Oldest first
+        QByteArray raw;
+        QVector<QVector<double> > frames;
+        int frameCapacity;
+    };
+
+    FlightOptions settings;
+    QVector<Record> records;                                                              // Ring of records...
+    int recordHead;
+    int recordCount;                                                                      // ...holding that many
+    QByteArray rawRing;
+    qint64 rawFirst;                                                                      // Oldest byte still in the ring
+    qint64 rawEnd;                                                                        // Bytes written since clear()
+    QVector<QVector<double> > frameRing;                                                  // One column per channel
+    int frameCapacity;
+    qint64 frameFirst;
+    qint64 frameEnd;                                                                      // Frames written since clear()
+    QByteArray textTail;                                                                  // End of the last chunk, for text split across reads
+    bool armed;
+    bool lastInside;                                                                      // Level trigger condition at the last sample
+    QString reason;
+    QTimer afterTimer;
+    int busy;
+
+    const Record &record (int index) const { return records[(recordHead + index) % records.size()]; }
+    bool intact (const Record &entry) const { return entry.start >= (entry.raw ? rawFirst : frameFirst); }
+    const Record *oldest (bool raw) const;                                                // Oldest record of that ring, nullptr if none
+    void makeRoom (bool raw, int size, qint64 now);                                       // Grow a ring rather than overwrite the span
+    void addRecord (const Record &entry);
+    void trim (qint64 now);
+    void fire (const QString &why);
+    static bool write (const QString &fileName, const QStringList &names, const Contents &contents);
+};
+
+#endif // FLIGHTRECORDER_HPP
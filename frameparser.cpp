@@ -0,0 +1,242 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "frameparser.hpp"
+#include <QtNumeric>
+#include <cctype>
+#include <cmath>
+
+/**
+ * @brief Constructor
+ */
+FrameParser::FrameParser() :
+  state (WAIT_START),
+  dropped (0)
+{
+    message.reserve (256);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Forget any partial message
+ */
+void FrameParser::reset()
+{
+    state = WAIT_START;
+    message.resize (0);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Run the message state machine over a chunk of received bytes
+ * @param data
+ * @param size
+ * @param batch Complete frames are appended here
+ * @param texts Optional, receives the text of each complete frame
+ */
+void FrameParser::feed (const char *data, int size, SampleBatch &batch, QStringList *texts)
+{
+    for (int i = 0; i < size; i++)
+      {
+        const char c = data[i];
+        switch (state)
+          {
+          case WAIT_START:                                                                // If waiting for start [$], examine each char
+            if (c == START_MSG)
+              {
+                state = IN_MESSAGE;
+                message.resize (0);
+              }
+            else if (!isspace ((unsigned char) c))
+              {
+                dropped++;
+              }
+            break;
+          case IN_MESSAGE:
+            if (c == END_MSG)
+              {
+                state = WAIT_START;
+                if (texts != nullptr)
+                  {
+                    texts->append (QString::fromLatin1 (message));
+                  }
+                endOfMessage (batch);
+              }
+            else if (isdigit ((unsigned char) c) || isspace ((unsigned char) c) || c == '-' || c == '.')
+              {
+                message.append (c);
+              }
+            break;
+          default:
+            break;
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Split the finished message on spaces and append one frame to the batch
+ * @param batch
+ */
+void FrameParser::endOfMessage (SampleBatch &batch)
+{
+    const int frame = batch.frames;
+    const char *p = message.constData();
+    const char *end = p + message.size();
+    int channel = 0;
+
+    for (;;)
+      {
+        const char *token = p;
+        while (p < end && *p != ' ')
+          {
+            p++;
+          }
+
+        if (batch.channels.size() <= channel)
+          {
+            batch.channels.resize (channel + 1);
+          }
+        QVector<double> &column = batch.channels[channel];
+        while (column.size() < frame)
+          {
+            column.append (qQNaN());                                                      // Channel was missing in earlier frames
+          }
+        column.append (toDouble (token, p));
+        channel++;
+
+        if (p >= end)
+          {
+            break;
+          }
+        p++;
+      }
+
+    /* Channels seen earlier in this batch but not in this frame */
+    for (int c = channel; c < batch.channels.size(); c++)
+      {
+        if (frame > 0 && batch.channels[c].size() == frame)
+          {
+            batch.channels[c].append (qQNaN());
+          }
+      }
+
+    batch.frames++;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Decimal string to double
+ *
+ * Up to 19 significant digits are gathered in an integer and scaled once by
+ * an exact power of ten, which is correctly rounded for the usual sensor
+ * values. Unlike strtod() it ignores the C locale set by Qt.
+ * @param begin
+ * @param end
+ * @return Parsed value, 0 if there are no digits
+ */
+double FrameParser::toDouble (const char *begin, const char *end)
+{
+    static const double powers[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *p = begin;
+    bool negative = false;
+    quint64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    while (p < end && isspace ((unsigned char) *p))
+      {
+        p++;
+      }
+    if (p < end && (*p == '-' || *p == '+'))
+      {
+        negative = (*p == '-');
+        p++;
+      }
+
+    /* Integer part */
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+      {
+        if (digits < 19)
+          {
+            mantissa = mantissa * 10 + quint64 (*p - '0');
+            digits += (mantissa != 0);
+          }
+        else
+          {
+            exponent++;
+          }
+      }
+
+    /* Fraction */
+    if (p < end && *p == '.')
+      {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+          {
+            if (digits < 19)
+              {
+                mantissa = mantissa * 10 + quint64 (*p - '0');
+                digits += (mantissa != 0);
+                exponent--;
+              }
+          }
+      }
+
+    /* Exponent */
+    if (p < end && (*p == 'e' || *p == 'E'))
+      {
+        bool negativeExponent = false;
+        int value = 0;
+        p++;
+        if (p < end && (*p == '-' || *p == '+'))
+          {
+            negativeExponent = (*p == '-');
+            p++;
+          }
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+          {
+            value = qMin (value * 10 + (*p - '0'), 9999);
+          }
+        exponent += negativeExponent ? -value : value;
+      }
+
+    double result = double (mantissa);
+    if (mantissa != 0 && exponent != 0)
+      {
+        if (exponent > 0)
+          {
+            result = exponent <= 22 ? result * powers[exponent] : result * std::pow (10.0, exponent);
+          }
+        else
+          {
+            result = -exponent <= 22 ? result / powers[-exponent] : result / std::pow (10.0, -exponent);
+          }
+      }
+    return negative ? -result : result;
+}
@@ -0,0 +1,69 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef FRAMEPARSER_HPP
+#define FRAMEPARSER_HPP
+
+#include <QByteArray>
+#include <QStringList>
+#include "samplebatch.hpp"
+
+#define START_MSG       '$'
+#define END_MSG         ';'
+
+#define WAIT_START      1
+#define IN_MESSAGE      2
+#define UNDEFINED       3
+
+/**
+ * @brief Turns the "$v0 v1 ... vn;" byte stream into SampleBatch columns
+ *
+ * Same rules as the original per-character state machine: only digits,
+ * white space, '-' and '.' are kept inside a message and values are space
+ * separated. Numbers are converted without going through QString.
+ */
+class FrameParser
+{
+public:
+    FrameParser();
+
+    /* Parse a chunk, append complete frames to 'batch' (and their text to 'texts' if given) */
+    void feed (const char *data, int size, SampleBatch &batch, QStringList *texts = nullptr);
+    void reset();
+    qint64 discarded() const { return dropped; }                                          // Non-blank bytes outside any message
+
+    /* Locale independent decimal conversion of [begin, end); empty input is 0 */
+    static double toDouble (const char *begin, const char *end);
+
+private:
+    int state;
+    qint64 dropped;
+    QByteArray message;                                                                   // Current message body
+
+    void endOfMessage (SampleBatch &batch);
+};
+
+#endif // FRAMEPARSER_HPP
@@ -0,0 +1,180 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "framerenderer.hpp"
+#include <QPainter>
+
+/**
+ * @brief Constructor, the thread is started by the first submit()
+ * @param parent
+ */
+FrameRenderer::FrameRenderer (QObject *parent) :
+    QThread (parent),
+    mHasPending (false),
+    mQuit (false)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor, waits for the frame being drawn
+ */
+FrameRenderer::~FrameRenderer()
+{
+    mLock.lock();
+    mQuit = true;
+    mWake.wakeOne();
+    mLock.unlock();
+    wait();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Queue a frame, replacing the one still waiting if any
+ * @param frame
+ */
+void FrameRenderer::submit (const TraceFrame &frame)
+{
+    QMutexLocker locker (&mLock);
+    mPending = frame;
+    mHasPending = true;
+    if (!isRunning())
+      {
+        start (QThread::LowPriority);
+      }
+    mWake.wakeOne();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Last finished frame
+ * @param image Shares the front buffer, keep it no longer than needed
+ * @param map Axes the frame was drawn with
+ * @param area Where it was drawn
+ * @return
+ */
+bool FrameRenderer::latest (QImage &image, PixelMap &map, QRect &area)
+{
+    QMutexLocker locker (&mLock);
+    if (mFront.isNull())
+      {
+        return false;
+      }
+    image = mFront;
+    map = mFrontMap;
+    area = mFrontArea;
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Take the newest frame, draw it into the back buffer and swap
+ */
+void FrameRenderer::run()
+{
+    TraceFrame frame;
+    forever
+      {
+        mLock.lock();
+        while (!mHasPending && !mQuit)
+          {
+            mWake.wait (&mLock);
+          }
+        if (mQuit)
+          {
+            mLock.unlock();
+            return;
+          }
+        frame = mPending;
+        mPending = TraceFrame();                                                          // Do not hold on to old blocks
+        mHasPending = false;
+        mLock.unlock();
+
+        render (frame);
+
+        mLock.lock();
+        mFront.swap (mBack);
+        mFrontMap = frame.map;
+        mFrontArea = frame.area;
+        mLock.unlock();
+        frame = TraceFrame();
+        emit frameReady();
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Draw all traces of a frame into mBack, on the render thread
+ * @param frame
+ */
+void FrameRenderer::render (const TraceFrame &frame)
+{
+    if (mBack.size() != frame.area.size())
+      {
+        mBack = QImage (frame.area.size(), QImage::Format_ARGB32_Premultiplied);
+      }
+    mBack.fill (Qt::transparent);                                                         // Detaches if the GUI still holds it
+    if (mBack.isNull())
+      {
+        return;
+      }
+
+    QPainter painter (&mBack);
+    painter.translate (-frame.area.topLeft());
+    const ChannelStore *store = nullptr;
+    StoreSnapshot *snapshot = nullptr;
+    QVector<StoreBlock> blocks;
+    for (int i = 0; i < frame.traces.size(); i++)
+      {
+        const TraceFrame::Trace &trace = frame.traces[i];
+        if (trace.store != store)
+          {
+            if (snapshot != nullptr)
+              {
+                ChannelStore::release (snapshot);
+              }
+            store = trace.store;
+            snapshot = store->acquire();                                                  // Once per store and frame, traces stay in step
+            blocks = snapshot->blocks();
+          }
+        if (trace.channel >= snapshot->channels)
+          {
+            continue;                                                                     // Added after the last publish()
+          }
+        TraceReducer::reduce (blocks, trace.channel, frame.map, mLines, mValues);
+        if (mLines.size() < 2)
+          {
+            continue;
+          }
+        mRaster.begin (frame.area);
+        mRaster.addPolyline (mLines.constData(), mLines.size());
+        mRaster.draw (&painter, trace.color);
+      }
+    if (snapshot != nullptr)
+      {
+        ChannelStore::release (snapshot);
+      }
+}
@@ -0,0 +1,100 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef FRAMERENDERER_HPP
+#define FRAMERENDERER_HPP
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QColor>
+#include "tracereducer.hpp"
+#include "traceraster.hpp"
+
+/**
+ * @brief What to draw in one frame; the data comes from the stores' published snapshots
+ */
+struct TraceFrame
+{
+    struct Trace
+    {
+        const ChannelStore *store;                                                        // Must outlive the renderer
+        int channel;
+        QColor color;
+    };
+
+    QVector<Trace> traces;                                                                // Drawn in order
+    PixelMap map;
+    QRect area;                                                                           // Axis rect in widget pixels
+};
+
+/**
+ * @brief Renders trace frames off screen on its own thread
+ *
+ * submit() replaces any frame still waiting, so the thread always works on
+ * the newest one and never queues behind the GUI. Frames are drawn into a
+ * back image which is swapped with the front one when done; latest() then
+ * hands out the front image while the next frame is being drawn. Each
+ * frame acquires the last snapshot published by every store it shows, so
+ * all its traces cover the same consistent [oldest, newest] frames and
+ * the thread appending to the store never waits for the drawing.
+ */
+class FrameRenderer : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit FrameRenderer (QObject *parent = nullptr);
+    ~FrameRenderer();
+
+    void submit (const TraceFrame &frame);
+    bool latest (QImage &image, PixelMap &map, QRect &area);                              // false until a frame is done
+
+signals:
+    void frameReady();
+
+protected:
+    virtual void run() Q_DECL_OVERRIDE;
+
+private:
+    QMutex mLock;
+    QWaitCondition mWake;
+    TraceFrame mPending;
+    bool mHasPending;
+    bool mQuit;
+    QImage mFront;                                                                        // Last finished frame
+    PixelMap mFrontMap;
+    QRect mFrontArea;
+    QImage mBack;                                                                         // Only touched by the thread
+    TraceRaster mRaster;
+    QVector<QPointF> mLines;
+    QVector<double> mValues;
+
+    void render (const TraceFrame &frame);
+};
+
+#endif // FRAMERENDERER_HPP
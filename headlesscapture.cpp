@@ -0,0 +1,518 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "headlesscapture.hpp"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QDir>
+#include <csignal>
+
+static volatile sig_atomic_t quitRequested = 0;
+
+static void onQuitSignal (int)
+{
+    quitRequested = 1;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ * @param parent
+ */
+HeadlessCapture::HeadlessCapture (QObject *parent) :
+  QObject (parent)
+{
+    connect (&statisticsTimer, SIGNAL (timeout()), this, SLOT (printStatistics()));
+    connect (&quitTimer, SIGNAL (timeout()), this, SLOT (checkQuit()));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor
+ */
+HeadlessCapture::~HeadlessCapture()
+{
+    for (int i = 0; i < captures.size(); i++)
+      {
+        delete captures[i]->reader;
+        delete captures[i]->port;
+        delete captures[i];
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Check the raw command line before any application object exists
+ * @param argc
+ * @param argv
+ * @return
+ */
+bool HeadlessCapture::requested (int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+      {
+        if (qstrcmp (argv[i], "--headless") == 0)
+          {
+            return true;
+          }
+      }
+    return false;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse the options, open the ports and recordings
+ * @param arguments QCoreApplication::arguments()
+ * @param exitCode Set when returning false
+ * @return true when capturing has started
+ */
+bool HeadlessCapture::start (const QStringList &arguments, int &exitCode)
+{
+    QTextStream err (stderr);
+    QCommandLineParser options;
+    options.setApplicationDescription ("Record \"$...;\" messages from serial ports without the plot window.");
+    options.addHelpOption();
+    options.addOption (QCommandLineOption ("headless", "Run without window."));
+    options.addOption (QCommandLineOption (QStringList() << "p" << "port", "Serial port to capture, repeat for more.", "name"));
+    options.addOption (QCommandLineOption (QStringList() << "b" << "baud", "Baud rate of every port (default 115200).", "rate", "115200"));
+    options.addOption (QCommandLineOption (QStringList() << "o" << "output", "Directory for the CSV recordings (default: current).", "dir", "."));
+    options.addOption (QCommandLineOption ("no-record", "Parse only, do not write CSV files."));
+    options.addOption (QCommandLineOption ("channels", "Received channels known from the start (default: as they arrive).", "count", "0"));
+    options.addOption (QCommandLineOption ("filter", "Filter stages for a received channel, as in the Filters dialog, repeatable.", "channel:spec"));
+    options.addOption (QCommandLineOption ("math", "Math channel expression, repeatable.", "expression"));
+    options.addOption (QCommandLineOption ("interval", "Seconds between statistics lines (default 1).", "seconds", "1"));
+    options.addOption (QCommandLineOption ("segment", "Split and/or compress recordings, e.g. \"size:256M hours:1 sync:1000 compress\".", "spec"));
+    options.addOption (QCommandLineOption ("reader", "Read every port on its own thread, e.g. \"fifo:80 cpu:2 mlock lowlatency buffer:65536\".", "spec"));
+    if (!options.parse (arguments))
+      {
+        err << options.errorText() << endl;
+        exitCode = 2;
+        return false;
+      }
+    if (options.isSet ("help"))
+      {
+        QTextStream (stdout) << options.helpText();
+        exitCode = 0;
+        return false;
+      }
+
+    const QStringList ports = options.values ("port");
+    if (ports.isEmpty())
+      {
+        err << "No --port given" << endl;
+        exitCode = 2;
+        return false;
+      }
+    const int baudRate = options.value ("baud").toInt();
+    const bool record = !options.isSet ("no-record");
+    const QDir output (options.value ("output"));
+    int channels = options.value ("channels").toInt();
+
+    SegmentOptions segmentOptions;
+    QString segmentError;
+    if (options.isSet ("segment") && !SegmentOptions::parse (options.value ("segment"), segmentOptions, &segmentError))
+      {
+        err << "Bad --segment: " << segmentError << endl;
+        exitCode = 2;
+        return false;
+      }
+
+    ReaderOptions readerOptions;
+    const bool threaded = options.isSet ("reader");
+    QString readerError;
+    if (threaded && !ReaderOptions::parse (options.value ("reader"), readerOptions, &readerError))
+      {
+        err << "Bad --reader: " << readerError << endl;
+        exitCode = 2;
+        return false;
+      }
+
+    /* Filtered and math columns are placed after the channels they need, so
+       those channels are registered up front and the CSV layout never changes */
+    QList<QPair<int, QString> > filters;
+    foreach (const QString &filter, options.values ("filter"))
+      {
+        const int colon = filter.indexOf (':');
+        bool ok = false;
+        const int channel = filter.left (colon).toInt (&ok);
+        if (colon < 0 || !ok || channel < 0)
+          {
+            err << "Bad --filter " << filter << ", expected channel:spec" << endl;
+            exitCode = 2;
+            return false;
+          }
+        filters.append (qMakePair (channel, filter.mid (colon + 1)));
+        channels = qMax (channels, channel + 1);
+      }
+
+    foreach (const QString &name, ports)
+      {
+        Capture *capture = new Capture;
+        capture->port = new QSerialPort (name);
+        captures.append (capture);
+
+        for (int c = 0; c < channels; c++)
+          {
+            capture->pipeline.addChannel (QString ("Channel %1").arg (c));
+          }
+        QString error;
+        for (int i = 0; i < filters.size(); i++)
+          {
+            if (!capture->pipeline.setFilter (filters[i].first, filters[i].second, &error))
+              {
+                err << "Bad --filter " << filters[i].second << ": " << error << endl;
+                exitCode = 2;
+                return false;
+              }
+          }
+        foreach (const QString &expression, options.values ("math"))
+          {
+            if (!capture->pipeline.addMath (expression, &error))
+              {
+                err << "Bad --math " << expression << ": " << error << endl;
+                exitCode = 2;
+                return false;
+              }
+          }
+
+        if (threaded)
+          {
+            capture->reader = new SerialReader (&buffers);
+            capture->reader->setOptions (readerOptions);
+            if (!capture->reader->open (name, baudRate, QSerialPort::Data8, QSerialPort::NoParity, QSerialPort::OneStop))
+              {
+                err << "Cannot open " << name << ": " << capture->reader->errorString() << endl;
+                exitCode = 1;
+                return false;
+              }
+            foreach (const QString &warning, capture->reader->statistics().warnings)
+              {
+                err << name << ": " << warning << endl;
+              }
+          }
+        else
+          {
+            if (!capture->port->open (QIODevice::ReadOnly))
+              {
+                err << "Cannot open " << name << ": " << capture->port->errorString() << endl;
+                exitCode = 1;
+                return false;
+              }
+            capture->port->setBaudRate (baudRate);
+            capture->port->setDataBits (QSerialPort::Data8);
+            capture->port->setParity (QSerialPort::NoParity);
+            capture->port->setStopBits (QSerialPort::OneStop);
+          }
+
+        if (record)
+          {
+            QString tag = capture->port->portName();
+            tag.replace (QRegExp ("[^A-Za-z0-9_]"), "_");
+            const QString fileName = output.filePath (CsvRecorder::defaultFileName (tag));
+            capture->recorder.setSegments (segmentOptions);
+            if (!capture->recorder.open (fileName))
+              {
+                err << "Cannot create " << fileName << endl;
+                exitCode = 1;
+                return false;
+              }
+            QTextStream (stdout) << name << " -> " << fileName << endl;
+          }
+
+        if (capture->reader != nullptr)
+          {
+            connect (capture->reader, SIGNAL (dataReady()), this, SLOT (readReader()));
+            connect (capture->reader, SIGNAL (failed(QString)), this, SLOT (onReaderFailed(QString)));
+            continue;
+          }
+        connect (capture->port, SIGNAL (readyRead()), this, SLOT (readData()));
+        connect (capture->port, SIGNAL (errorOccurred(QSerialPort::SerialPortError)), this, SLOT (onError(QSerialPort::SerialPortError)));
+      }
+
+    signal (SIGINT, onQuitSignal);
+    signal (SIGTERM, onQuitSignal);
+    quitTimer.start (100);
+    statisticsTimer.start (qMax (1, qRound (options.value ("interval").toDouble() * 1000)));
+    clock.start();
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Capture a port or reader belongs to
+ * @param port
+ * @return
+ */
+HeadlessCapture::Capture *HeadlessCapture::captureOf (QObject *port)
+{
+    for (int i = 0; i < captures.size(); i++)
+      {
+        if (captures[i]->port == port || captures[i]->reader == port)
+          {
+            return captures[i];
+          }
+      }
+    return nullptr;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse, filter and record everything the port has buffered
+ */
+void HeadlessCapture::readData()
+{
+    Capture *capture = captureOf (sender());
+    if (capture != nullptr)
+      {
+        drain (capture);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Run what the port has buffered through the pipeline into the recording
+ * @param capture
+ */
+void HeadlessCapture::drain (Capture *capture)
+{
+    ReadBuffer *buffer = buffers.acquire();
+    if (buffer == nullptr)
+      {
+        return;                                                                           // Stays in the port buffer, counted by the pool
+      }
+    while ((buffer->size = int (capture->port->read (buffer->bytes(), buffer->capacity()))) > 0)
+      {
+        capture->bytes += buffer->size;
+        if (capture->pipeline.feed (buffer->constBytes(), buffer->size) > 0)
+          {
+            capture->frames += capture->pipeline.batch().frames;
+            capture->recorder.write (capture->pipeline.batch());
+          }
+      }
+    buffers.release (buffer);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse, filter and record the buffers a reader thread has queued
+ */
+void HeadlessCapture::readReader()
+{
+    Capture *capture = captureOf (sender());
+    if (capture != nullptr)
+      {
+        drainReader (capture);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Run the queued buffers through the pipeline into the recording and give them back
+ * @param capture
+ */
+void HeadlessCapture::drainReader (Capture *capture)
+{
+    ReadBuffer *buffer;
+    while ((buffer = capture->reader->take()) != nullptr)
+      {
+        capture->bytes += buffer->size;
+        if (capture->pipeline.feed (buffer->constBytes(), buffer->size) > 0)
+          {
+            capture->frames += capture->pipeline.batch().frames;
+            capture->recorder.write (capture->pipeline.batch());
+          }
+        buffers.release (buffer);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Record the frames the pipeline still holds, then close the recording
+ * @param capture
+ */
+void HeadlessCapture::finish (Capture *capture)
+{
+    if (capture->pipeline.flush() > 0)
+      {
+        capture->frames += capture->pipeline.batch().frames;
+        capture->recorder.write (capture->pipeline.batch());
+      }
+    capture->recorder.close();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Whether any port is still captured, by the GUI thread or a reader
+ * @return
+ */
+bool HeadlessCapture::anyOpen() const
+{
+    for (int i = 0; i < captures.size(); i++)
+      {
+        if (captures[i]->port->isOpen() || (captures[i]->reader != nullptr && captures[i]->reader->isRunning()))
+          {
+            return true;
+          }
+      }
+    return false;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief A reader thread lost its port: record what it read, the last one ends the run
+ * @param error
+ */
+void HeadlessCapture::onReaderFailed (const QString &error)
+{
+    Capture *capture = captureOf (sender());
+    if (capture == nullptr)
+      {
+        return;
+      }
+
+    capture->errors++;
+    QTextStream (stderr) << capture->reader->portName() << ": " << error << endl;
+    capture->reader->close();
+    drainReader (capture);
+    finish (capture);
+    if (!anyOpen())
+      {
+        stop (1);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Count port errors; a port that went away is closed, the last one ends the run
+ * @param error
+ */
+void HeadlessCapture::onError (QSerialPort::SerialPortError error)
+{
+    Capture *capture = captureOf (sender());
+    if (capture == nullptr || error == QSerialPort::NoError)
+      {
+        return;
+      }
+
+    capture->errors++;
+    if (error != QSerialPort::ResourceError)
+      {
+        return;
+      }
+
+    QTextStream (stderr) << capture->port->portName() << ": " << capture->port->errorString() << endl;
+    capture->port->close();
+    finish (capture);
+    if (!anyOpen())
+      {
+        stop (1);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief One line per port: rates since the last report, totals and drops
+ */
+void HeadlessCapture::printStatistics()
+{
+    QTextStream out (stdout);
+    const qint64 now = clock.elapsed();
+    const double seconds = qMax<qint64> (1, now - lastReport) / 1000.0;
+    lastReport = now;
+
+    for (int i = 0; i < captures.size(); i++)
+      {
+        Capture *capture = captures[i];
+        out << capture->port->portName()
+            << QString (": %1 frames/s %2 kB/s").arg ((capture->frames - capture->lastFrames) / seconds, 0, 'f', 0)
+                                                .arg ((capture->bytes - capture->lastBytes) / seconds / 1024.0, 0, 'f', 1)
+            << QString (", %1 frames %2 kB").arg (capture->frames).arg (capture->bytes / 1024)
+            << QString (", dropped %1 B, %2 errors").arg (capture->pipeline.discarded()).arg (capture->errors);
+        if (capture->pipeline.strayValues() > 0)
+          {
+            out << QString (", %1 stray values").arg (capture->pipeline.strayValues());
+          }
+        if (capture->recorder.isOpen())
+          {
+            out << QString (", recorded %1 kB").arg (capture->recorder.bytes() / 1024);
+            if (capture->recorder.storedBlocks() > 0)
+              {
+                out << QString (" (%1 blocks stored uncompressed)").arg (capture->recorder.storedBlocks());
+              }
+          }
+        out << endl;
+        if (capture->reader != nullptr)
+          {
+            out << "  reader: " << capture->reader->statistics().toString() << endl;
+          }
+        capture->lastFrames = capture->frames;
+        capture->lastBytes = capture->bytes;
+      }
+    out << QString ("read buffers: %1 of %2 free, fewest %3, exhausted %4 times").arg (buffers.available()).arg (buffers.count())
+                                                                                  .arg (buffers.lowWater()).arg (buffers.exhausted())
+        << endl;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Leave once SIGINT/SIGTERM arrived
+ */
+void HeadlessCapture::checkQuit()
+{
+    if (quitRequested)
+      {
+        stop (0);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Drain the ports, close the recordings, print the totals and quit
+ * @param exitCode
+ */
+void HeadlessCapture::stop (int exitCode)
+{
+    quitTimer.stop();
+    statisticsTimer.stop();
+    for (int i = 0; i < captures.size(); i++)
+      {
+        if (captures[i]->port->isOpen())
+          {
+            captures[i]->port->waitForReadyRead (0);
+            drain (captures[i]);
+            captures[i]->port->close();
+          }
+        if (captures[i]->reader != nullptr)
+          {
+            captures[i]->reader->close();
+            drainReader (captures[i]);
+          }
+        finish (captures[i]);
+      }
+    printStatistics();
+    QCoreApplication::exit (exitCode);
+}
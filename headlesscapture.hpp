@@ -0,0 +1,97 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef HEADLESSCAPTURE_HPP
+#define HEADLESSCAPTURE_HPP
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QtSerialPort/QSerialPort>
+#include "ingestpipeline.hpp"
+#include "csvrecorder.hpp"
+#include "bufferpool.hpp"
+#include "serialreader.hpp"
+
+/**
+ * @brief Capture and record without any window ("--headless")
+ *
+ * Every port runs its own parse/filter/math pipeline and CSV recorder
+ * straight from readyRead(). Throughput and drop counters are printed to
+ * stdout every few seconds and once more when SIGINT/SIGTERM ends the run.
+ * Ports are read into pooled buffers, so a steady capture allocates nothing.
+ * With "--reader" each port is read by a SerialReader thread instead.
+ */
+class HeadlessCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HeadlessCapture (QObject *parent = nullptr);
+    ~HeadlessCapture();
+
+    static bool requested (int argc, char *argv[]);                                       // "--headless" on the command line
+    bool start (const QStringList &arguments, int &exitCode);                             // false: nothing to capture, quit with exitCode
+
+private slots:
+    void readData();
+    void readReader();
+    void onReaderFailed (const QString &error);
+    void onError (QSerialPort::SerialPortError error);
+    void printStatistics();
+    void checkQuit();
+
+private:
+    struct Capture
+    {
+        QSerialPort *port;                                                                // Not opened when a reader is used
+        SerialReader *reader = nullptr;
+        IngestPipeline pipeline;
+        CsvRecorder recorder;
+        qint64 bytes = 0;                                                                 // Totals...
+        qint64 frames = 0;
+        qint64 errors = 0;
+        qint64 lastBytes = 0;                                                             // ...at the previous report
+        qint64 lastFrames = 0;
+    };
+
+    QList<Capture*> captures;
+    BufferPool buffers;                                                                   // Shared by all ports
+    QTimer statisticsTimer;
+    QTimer quitTimer;                                                                     // Polls the signal flag
+    QElapsedTimer clock;
+    qint64 lastReport = 0;
+
+    Capture *captureOf (QObject *port);
+    void drain (Capture *capture);
+    void drainReader (Capture *capture);
+    void finish (Capture *capture);                                                       // Record the held frames and close the file
+    bool anyOpen() const;
+    void stop (int exitCode);
+};
+
+#endif // HEADLESSCAPTURE_HPP
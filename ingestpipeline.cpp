@@ -0,0 +1,361 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "ingestpipeline.hpp"
+#include <QtNumeric>
+#include <cstring>
+
+/**
+ * @brief Append frames [first, first + count) of one batch to another
+ *
+ * Columns missing on either side are filled with NaN, so every column of
+ * 'to' keeps one value per frame.
+ * @param from
+ * @param first
+ * @param count
+ * @param to
+ */
+static void appendFrames (const SampleBatch &from, int first, int count, SampleBatch &to)
+{
+    if (count <= 0)
+      {
+        return;
+      }
+    if (to.channels.size() < from.channels.size())
+      {
+        to.channels.resize (from.channels.size());
+      }
+    for (int c = 0; c < to.channels.size(); c++)
+      {
+        QVector<double> &column = to.channels[c];
+        const int had = column.size();
+        column.resize (to.frames + count);
+        for (int f = had; f < to.frames; f++)
+          {
+            column[f] = qQNaN();
+          }
+        if (from.hasChannel (c))
+          {
+            memcpy (column.data() + to.frames, from.channels[c].constData() + first, count * sizeof (double));
+            continue;
+          }
+        for (int f = 0; f < count; f++)
+          {
+            column[to.frames + f] = qQNaN();
+          }
+      }
+    to.frames += count;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ */
+IngestPipeline::IngestPipeline()
+  : strays (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Forget all columns, filters and math channels
+ */
+void IngestPipeline::clear()
+{
+    names.clear();
+    channelColumn.clear();
+    filteredColumn.clear();
+    filterChains.clear();
+    mathExpressions.clear();
+    mathColumns.clear();
+    output.clear();
+    held.clear();
+    strays = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Register the next received channel
+ * @param name Column name
+ */
+void IngestPipeline::addChannel (const QString &name)
+{
+    channelColumn.append (names.size());
+    filteredColumn.append (-1);
+    filterChains.append (FilterChain());
+    names.append (name);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse received bytes and run the complete frames through the stages
+ *
+ * Frames of a new frame format may be held back for a few batches, see
+ * detectChannels().
+ * @param data
+ * @param size
+ * @param texts If given, gets the text of every complete message
+ * @return Number of frames in batch()
+ */
+int IngestPipeline::feed (const char *data, int size, QStringList *texts)
+{
+    raw.clear();
+    parser.feed (data, size, raw, texts);
+    const SampleBatch &ready = raw.frames > 0 ? detectChannels (raw) : raw;
+    if (ready.frames > 0)
+      {
+        run (ready);
+      }
+    else
+      {
+        output.clear();
+      }
+    return output.frames;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Let the held frames through without their extra values
+ *
+ * For the end of a stream: a run of wider frames can no longer reach
+ * SCHEMA_FRAMES, so its extra values are counted as strays.
+ * @return Number of frames in batch()
+ */
+int IngestPipeline::flush()
+{
+    output.clear();
+    if (held.frames == 0)
+      {
+        return 0;
+      }
+    for (int c = channelColumn.size(); c < held.channels.size(); c++)
+      {
+        for (int f = 0; held.hasChannel (c) && f < held.frames; f++)
+          {
+            strays += !qIsNaN (held.channels[c][f]);
+          }
+      }
+    run (held);
+    held.clear();
+    return output.frames;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Run already parsed frames (one column per received channel) through the stages
+ *
+ * Imported files have a fixed layout, so every column is a channel at once.
+ * @param in
+ */
+void IngestPipeline::process (const SampleBatch &in)
+{
+    for (int c = channelColumn.size(); c < in.channels.size(); c++)
+      {
+        addChannel (QString ("Channel %1").arg (c));
+      }
+    run (in);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Ingest stage between parsing and plotting/recording
+ *
+ * Every received column with a channel is copied to its output column and run through the channel's filter chain, if any,
+ * into the column of its filtered version. Math channels are evaluated last.
+ * @param in
+ */
+void IngestPipeline::run (const SampleBatch &in)
+{
+    output.clear();
+    output.frames = in.frames;
+    if (output.channels.size() < names.size())
+      {
+        output.channels.resize (names.size());
+      }
+
+    const int received = qMin (in.channels.size(), channelColumn.size());
+    for (int c = 0; c < received; c++)
+      {
+        if (!in.hasChannel (c))
+          {
+            continue;
+          }
+        /* Copied, not shared: sharing would make both batches reallocate on their next clear() */
+        QVector<double> &column = output.channels[channelColumn[c]];
+        column.resize (in.frames);
+        memcpy (column.data(), in.channels[c].constData(), in.frames * sizeof (double));
+        if (filteredColumn[c] >= 0 && !filterChains[c].isEmpty())
+          {
+            filterChains[c].process (in.channels[c], output.channels[filteredColumn[c]]);
+          }
+      }
+
+    /* Derived channels are computed from the received (unfiltered) columns */
+    if (!mathExpressions.isEmpty())
+      {
+        mathInputs.resize (in.channels.size());
+        for (int c = 0; c < in.channels.size(); c++)
+          {
+            mathInputs[c] = in.hasChannel (c) ? in.channels[c].constData() : nullptr;
+          }
+        for (int m = 0; m < mathExpressions.size(); m++)
+          {
+            mathExpressions[m].evaluate (mathInputs, output.frames, output.channels[mathColumns[m]]);
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Hold back the frames of a new, wider frame format until it is stable
+ *
+ * Only does work while a batch has values beyond the known channels,
+ * or frames are held from the last one. The width of a frame is the number
+ * of values it carries; a width above the known channels has to repeat for
+ * SCHEMA_FRAMES frames in a row before its channels are added, all at once.
+ * Until then those frames wait here, so once the width is accepted they go
+ * out with every value, the first frames of a session included. Frames
+ * ending a run that did not last are let through without their extra
+ * values, which are counted as strays.
+ * @param in Parsed frames
+ * @return The frames to process now, 'in' itself in the steady state
+ */
+const SampleBatch &IngestPipeline::detectChannels (const SampleBatch &in)
+{
+    /* Batches are reused, so columns beyond the channels stay; only the ones this batch filled count */
+    int extra = channelColumn.size();
+    while (extra < in.channels.size() && !in.hasChannel (extra))
+      {
+        extra++;
+      }
+    if (held.frames == 0 && extra == in.channels.size())
+      {
+        return in;
+      }
+
+    combined.clear();
+    appendFrames (held, 0, held.frames, combined);
+    appendFrames (in, 0, in.frames, combined);
+    held.clear();
+
+    int accepted = channelColumn.size();
+    int runWidth = 0;                                                                     // Width of the current run of wider frames...
+    int runStart = 0;                                                                     // ...and its first frame
+    for (int f = 0; f < combined.frames; f++)
+      {
+        int width = accepted;
+        for (int c = combined.channels.size() - 1; c >= accepted; c--)
+          {
+            if (combined.hasChannel (c) && !qIsNaN (combined.channels[c][f]))
+              {
+                width = c + 1;
+                break;
+              }
+          }
+
+        if (width == accepted)
+          {
+            runWidth = 0;
+            continue;
+          }
+        if (width != runWidth)
+          {
+            runWidth = width;
+            runStart = f;
+          }
+        if (f - runStart + 1 >= SCHEMA_FRAMES)
+          {
+            accepted = runWidth;
+            runWidth = 0;
+          }
+      }
+
+    for (int c = channelColumn.size(); c < accepted; c++)
+      {
+        addChannel (QString ("Channel %1").arg (c));
+      }
+
+    /* A run still too short waits for the next batch */
+    const int ready = runWidth > 0 ? runStart : combined.frames;
+    appendFrames (combined, ready, combined.frames - ready, held);
+    for (int c = 0; c < combined.channels.size(); c++)
+      {
+        combined.channels[c].resize (ready);
+        for (int f = 0; c >= accepted && f < ready; f++)
+          {
+            strays += !qIsNaN (combined.channels[c][f]);
+          }
+      }
+    combined.frames = ready;
+    return combined;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Set the filter stages of a received channel
+ *
+ * The first non-empty chain adds a "(filtered)" column; it is kept when the
+ * chain is emptied again, so columns never move.
+ * @param channel Received channel
+ * @param spec See FilterChain::parse()
+ * @param error Filled if the spec is invalid
+ * @return false if the spec is invalid, the filter is then unchanged
+ */
+bool IngestPipeline::setFilter (int channel, const QString &spec, QString *error)
+{
+    if (!filterChains[channel].parse (spec, error))
+      {
+        return false;
+      }
+    filterChains[channel].reset();
+
+    if (!filterChains[channel].isEmpty() && filteredColumn[channel] < 0)
+      {
+        filteredColumn[channel] = names.size();
+        names.append (names[channelColumn[channel]] + " (filtered)");
+      }
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Add a math channel column
+ * @param text Expression over ch0, ch1, ...
+ * @param error Filled if the expression does not compile
+ * @return false if it does not compile
+ */
+bool IngestPipeline::addMath (const QString &text, QString *error)
+{
+    MathExpression expression;
+    if (!expression.compile (text, error))
+      {
+        return false;
+      }
+    mathExpressions.append (expression);
+    mathColumns.append (names.size());
+    names.append (expression.text());
+    return true;
+}
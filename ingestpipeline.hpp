@@ -0,0 +1,97 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef INGESTPIPELINE_HPP
+#define INGESTPIPELINE_HPP
+
+#include <QStringList>
+#include "samplebatch.hpp"
+#include "frameparser.hpp"
+#include "filterchain.hpp"
+#include "mathchannel.hpp"
+
+#define SCHEMA_FRAMES        16                                                           // Frames in a row with more values before they become channels
+
+/**
+ * @brief Parse, filter and derive stages, shared by the window and headless mode
+ *
+ * Received channels, their filtered versions and math channels each get an
+ * output column, numbered in creation order. batch() holds the frames of the
+ * last feed() or process() with one column per output column; users add a
+ * graph (or a CSV field) whenever columnCount() grows.
+ *
+ * Received extra values only become channels once SCHEMA_FRAMES frames in a
+ * row have carried the same number of them, so a garbled frame with a stray
+ * token does not leave a channel behind; its values count as strayValues().
+ * Frames are held back meanwhile, so a channel that is accepted loses none.
+ */
+class IngestPipeline
+{
+public:
+    IngestPipeline();
+
+    void clear();                                                                         // Forget channels, filters and math channels
+    void reset() { parser.reset(); held.clear(); }                                        // Drop any partial message and held frames, flush() first
+    int flush();                                                                          // Let held frames through, returns the frames
+
+    int feed (const char *data, int size, QStringList *texts = nullptr);                  // Parse and process, returns the frames
+    void process (const SampleBatch &raw);                                                // Process frames parsed elsewhere
+    const SampleBatch &batch() const { return output; }
+    qint64 discarded() const { return parser.discarded(); }
+    qint64 strayValues() const { return strays; }                                         // Values beyond the known channels, dropped
+
+    int columnCount() const { return names.size(); }
+    QString columnName (int column) const { return names[column]; }
+    void setColumnName (int column, const QString &name) { names[column] = name; }
+
+    int channelCount() const { return channelColumn.size(); }
+    int channelOfColumn (int column) const { return channelColumn.indexOf (column); }     // -1 if not a received channel
+    void addChannel (const QString &name);                                                // Next received channel
+
+    bool setFilter (int channel, const QString &spec, QString *error = nullptr);          // Empty spec removes the filter
+    QString filterSpec (int channel) const { return filterChains[channel].spec(); }
+    bool addMath (const QString &text, QString *error = nullptr);
+
+private:
+    FrameParser parser;                                                                   // "$...;" messages to sample columns
+    SampleBatch raw;                                                                      // Frames of one read, one column per received value
+    SampleBatch output;                                                                   // Same frames, one column per output column
+    QStringList names;
+    QVector<int> channelColumn;                                                           // Column of each received channel
+    QVector<int> filteredColumn;                                                          // Column of its filtered version, -1 if none
+    QVector<FilterChain> filterChains;                                                    // Filter stages of each received channel
+    QVector<MathExpression> mathExpressions;                                              // Derived channels...
+    QVector<int> mathColumns;                                                             // ...and their columns
+    SampleBatch held;                                                                     // Frames waiting for their format to be accepted
+    SampleBatch combined;                                                                 // Held and new frames, while detecting
+    qint64 strays;
+    QVector<const double*> mathInputs;                                                    // Received columns handed to the expressions
+
+    void run (const SampleBatch &in);
+    const SampleBatch &detectChannels (const SampleBatch &in);
+};
+
+#endif // INGESTPIPELINE_HPP
@@ -25,10 +25,37 @@
 ****************************************************************************/
 
 #include "mainwindow.hpp"
+#include "headlesscapture.hpp"
+#include "batchrenderer.hpp"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    /* Capture without any window; no QApplication, so no display is needed */
+    if (HeadlessCapture::requested (argc, argv))
+      {
+        QCoreApplication app (argc, argv);
+        HeadlessCapture capture;
+        int exitCode;
+        if (!capture.start (app.arguments(), exitCode))
+          {
+            return exitCode;
+          }
+        return app.exec();
+      }
+
+    /* Render recordings to files; the plot needs a QApplication but no screen */
+    if (BatchRenderer::requested (argc, argv))
+      {
+        if (qEnvironmentVariableIsEmpty ("QT_QPA_PLATFORM"))
+          {
+            qputenv ("QT_QPA_PLATFORM", "offscreen");
+          }
+        QApplication app (argc, argv);
+        BatchRenderer renderer;
+        return renderer.run (app.arguments());
+      }
+
     QApplication a(argc, argv);
 
     /* Apply style sheet */
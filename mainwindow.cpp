@@ -26,6 +26,7 @@
 
 #include "mainwindow.hpp"
 #include "ui_mainwindow.h"
+#include <QThreadPool>
 #include <x86intrin.h>
 
 /**
@@ -70,7 +71,6 @@ MainWindow::MainWindow (QWidget *parent) :
   dataPointNumber (0),
   channels(0),
   serialPort (nullptr),
-  STATE (WAIT_START),
   NUMBER_OF_POINTS (500)
 {
   ui->setupUi (this);
@@ -94,7 +94,13 @@ MainWindow::MainWindow (QWidget *parent) :
   /* Connect update timer to replot slot */
   connect (&updateTimer, SIGNAL (timeout()), this, SLOT (replot()));
 
-  m_csvFile = nullptr;
+  connect (&plotExport, SIGNAL (saved(QString, bool)), this, SLOT (onPngSaved(QString, bool)));
+  connect (&readerTimer, SIGNAL (timeout()), this, SLOT (showReaderStatistics()));
+  connect (&flightRecorder, SIGNAL (triggered(QString)), this, SLOT (onFlightTriggered(QString)));
+  connect (&flightRecorder, SIGNAL (dumped(QString, bool)), this, SLOT (onFlightDumped(QString, bool)));
+
+  traceCompositor = new TraceCompositor (ui->plot);                                        // Owned by the plot
+  tracePresenter = new TracePresenter (ui->plot);
 }
 
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -104,12 +110,17 @@ MainWindow::MainWindow (QWidget *parent) :
  */
 MainWindow::~MainWindow()
 {
+    /* Both read the store member, which goes before the plot's children do */
+    delete tracePresenter;                                                                // Joins the render thread
+    delete traceCompositor;
+    QThreadPool::globalInstance()->waitForDone();                                         // Tiles still in flight
     closeCsvFile();
       
     if (serialPort != nullptr)
       {
         delete serialPort;
       }
+    delete serialReader;                                                                  // Gives its buffers back to readBuffers
     delete ui;
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -236,6 +247,47 @@ void MainWindow::setupPlot()
     ui->plot->legend->setBorderPen (gui_colors[2]);
     /* By default, the legend is in the inset layout of the main axis rect. So this is how we access it to change legend placement */
     ui->plot->axisRect()->insetLayout()->setInsetAlignment (0, Qt::AlignTop|Qt::AlignRight);
+
+    /* Persistence maps live in their own layer, shown instead of the graphs' "main" layer */
+    if (ui->plot->layer ("persistence") == nullptr)
+      {
+        ui->plot->addLayer ("persistence", ui->plot->layer ("main"), QCustomPlot::limAbove);
+      }
+    ui->plot->layer ("persistence")->setVisible (persistence);
+    ui->plot->layer ("main")->setVisible (!persistence);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Create a graph with its legend, channel list and persistence entries
+ * @param name Graph name
+ * @return Index of the new graph
+ */
+int MainWindow::addChannel (const QString &name)
+{
+    const QColor color = line_colors[channels % CUSTOM_LINE_COLORS];
+
+    ChannelView *view = new ChannelView (ui->plot->xAxis, ui->plot->yAxis, &store, store.addChannel());
+    view->setPen (color);
+    view->setName (name);
+    traceCompositor->adopt (view);
+    tracePresenter->adopt (view);
+    channelViews.append (view);
+    if(ui->plot->legend->itemWithPlottable(view))
+    {
+        ui->plot->legend->itemWithPlottable (view)->setTextColor (color);
+    }
+    ui->listWidget_Channels->addItem(name);
+    ui->listWidget_Channels->item(channels)->setForeground(QBrush(color));
+
+    PersistenceMap *persistenceMap = new PersistenceMap (ui->plot->xAxis, ui->plot->yAxis);
+    persistenceMap->setLayer ("persistence");
+    persistenceMap->setColor (color);
+    persistenceMap->removeFromLegend();
+    persistenceMaps.append (persistenceMap);
+    windowRanges.append (SlidingMinMax());
+
+    return channels++;
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -269,15 +321,36 @@ void MainWindow::enable_com_controls (bool enable)
  */
 void MainWindow::openPort (QSerialPortInfo portInfo, int baudRate, QSerialPort::DataBits dataBits, QSerialPort::Parity parity, QSerialPort::StopBits stopBits)
 {
-    serialPort = new QSerialPort(portInfo, nullptr);                                            // Create a new serial port
-
     connect (this, SIGNAL(portOpenOK()), this, SLOT(portOpenedSuccess()));                 // Connect port signals to GUI slots
     connect (this, SIGNAL(portOpenFail()), this, SLOT(portOpenedFail()));
     connect (this, SIGNAL(portClosed()), this, SLOT(onPortClosed()));
-    connect (this, SIGNAL(newData(QStringList)), this, SLOT(onNewDataArrived(QStringList)));
+    connect (this, SIGNAL(newData(SampleBatch)), this, SLOT(onNewDataArrived(SampleBatch)));
+    connect (this, SIGNAL(newData(SampleBatch)), this, SLOT(saveStream(SampleBatch)));
+
+    if (!readerSpec.isEmpty())
+      {
+        /* The reader thread opens and reads the port itself */
+        serialReader = new SerialReader (&readBuffers);
+        serialReader->setOptions (readerOptions);
+        connect (serialReader, SIGNAL(dataReady()), this, SLOT(readerData()));
+        connect (serialReader, SIGNAL(failed(QString)), this, SLOT(onReaderFailed(QString)));
+        if (serialReader->open (portInfo.portName(), baudRate, dataBits, parity, stopBits))
+          {
+            readerTimer.start (1000);
+            emit portOpenOK();
+          }
+        else
+          {
+            emit portOpenedFail();
+            qDebug() << serialReader->errorString();
+            delete serialReader;
+            serialReader = nullptr;
+          }
+        return;
+      }
+
+    serialPort = new QSerialPort (portInfo, nullptr);                                     // Not with a reader, which has its own
     connect (serialPort, SIGNAL(readyRead()), this, SLOT(readData()));
-    
-    connect (this, SIGNAL(newData(QStringList)), this, SLOT(saveStream(QStringList)));
 
     if (serialPort->open (QIODevice::ReadWrite))
       {
@@ -291,6 +364,8 @@ void MainWindow::openPort (QSerialPortInfo portInfo, int baudRate, QSerialPort::
       {
         emit portOpenedFail();
         qDebug() << serialPort->errorString();
+        delete serialPort;
+        serialPort = nullptr;
       }
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -308,13 +383,16 @@ void MainWindow::onPortClosed()
     //--
     closeCsvFile();
     
-    disconnect (serialPort, SIGNAL(readyRead()), this, SLOT(readData()));
+    if (serialPort != nullptr)
+      {
+        disconnect (serialPort, SIGNAL(readyRead()), this, SLOT(readData()));
+      }
     disconnect (this, SIGNAL(portOpenOK()), this, SLOT(portOpenedSuccess()));             // Disconnect port signals to GUI slots
     disconnect (this, SIGNAL(portOpenFail()), this, SLOT(portOpenedFail()));
     disconnect (this, SIGNAL(portClosed()), this, SLOT(onPortClosed()));
-    disconnect (this, SIGNAL(newData(QStringList)), this, SLOT(onNewDataArrived(QStringList)));
+    disconnect (this, SIGNAL(newData(SampleBatch)), this, SLOT(onNewDataArrived(SampleBatch)));
   
-    disconnect (this, SIGNAL(newData(QStringList)), this, SLOT(saveStream(QStringList)));
+    disconnect (this, SIGNAL(newData(SampleBatch)), this, SLOT(saveStream(SampleBatch)));
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -368,83 +446,119 @@ void MainWindow::portOpenedFail()
  */
 void MainWindow::replot()
 {
-  ui->plot->xAxis->setRange (dataPointNumber - ui->spinPoints->value(), dataPointNumber);
+  overload.begin();
+  double deferredFirstKey;
+  while (overload.takeDeferred (deferredFirstKey, deferredBatch))
+    {
+      showBatch (deferredFirstKey, deferredBatch);
+    }
+
+  if (persistence)
+    {
+      /* Sweep display: x axis is the position inside the sweep */
+      ui->plot->xAxis->setRange (0, ui->spinPoints->value());
+      for (int i = 0; i < persistenceMaps.size(); i++)
+        {
+          persistenceMaps[i]->setSweep (ui->spinPoints->value());
+          persistenceMaps[i]->setVisible (channelViews[i]->visible());
+        }
+    }
+  else
+    {
+      ui->plot->xAxis->setRange (dataPointNumber - ui->spinPoints->value(), dataPointNumber);
+    }
+
+  double lower, upper;
+  if (autoY && windowRange (lower, upper))
+    {
+      /* Same margin as the AutoScale button, spin boxes only display it */
+      ui->spinAxesMin->blockSignals (true);
+      ui->spinAxesMax->blockSignals (true);
+      ui->spinAxesMin->setValue (int (lower) + int (lower * 0.1));
+      ui->spinAxesMax->setValue (int (upper) + int (upper * 0.1));
+      ui->spinAxesMin->blockSignals (false);
+      ui->spinAxesMax->blockSignals (false);
+      ui->plot->yAxis->setRange (ui->spinAxesMin->value(), ui->spinAxesMax->value());
+    }
+  store.publish();                                                                        // New frames for the render thread, once per replot
   ui->plot->replot();
+
+  if (waterfallWindow != nullptr)
+    {
+      waterfallWindow->refresh();
+    }
+
+  if (overload.end())
+    {
+      ui->statusBar->showMessage (overload.toString());
+    }
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /**
- * @brief Slot for new data from serial port . Data is comming in QStringList and needs to be parsed
+ * @brief Slot for new data from serial port. Data comes as one column per graph
  * @param newData
  */
-void MainWindow::onNewDataArrived(QStringList newData)
+void MainWindow::onNewDataArrived (const SampleBatch &newData)
 {
-    static int data_members = 0;
-    static int channel = 0;
-    static int i = 0;
-    volatile bool you_shall_NOT_PASS = false;
+    /* Also while paused: only the view is frozen, it keeps showing the
+       range it had from the same store until replot() moves it to live */
+    store.append (dataPointNumber, newData);                                              // Every sample, whatever the display keeps
+    flightRecorder.addBatch (dataPointNumber, newData);
 
-    /* When a fast baud rate is set (921kbps was the first to starts to bug),
-       this method is called multiple times (2x in the 921k tests), so a flag
-       is used to throttle
-       TO-DO: Separate processes, buffer data (1) and process data (2) */
-    while (you_shall_NOT_PASS) {}
-    you_shall_NOT_PASS = true;
-
-    if (plotting)
+    if (overload.policy() == OverloadDropOldest && overload.overloaded())
+      {
+        overload.defer (dataPointNumber, newData);
+      }
+    else
       {
-        /* Get size of received list */
-        data_members = newData.size();
+        showBatch (dataPointNumber, newData);
+      }
 
-        /* Parse data */
-        for (i = 0; i < data_members; i++)
-          {
-            /* Update number of axes if needed */
-            while (ui->plot->plottableCount() <= channel)
-              {
-                /* Add new channel data */
-                ui->plot->addGraph();
-                ui->plot->graph()->setPen (line_colors[channels % CUSTOM_LINE_COLORS]);
-                ui->plot->graph()->setName (QString("Channel %1").arg(channels));
-                if(ui->plot->legend->item(channels))
-                {
-                    ui->plot->legend->item (channels)->setTextColor (line_colors[channels % CUSTOM_LINE_COLORS]);
-                }
-                ui->listWidget_Channels->addItem(ui->plot->graph()->name());
-                ui->listWidget_Channels->item(channel)->setForeground(QBrush(line_colors[channels % CUSTOM_LINE_COLORS]));
-                channels++;
-              }
+    dataPointNumber += newData.frames;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-            /* [TODO] Method selection and plotting */
-            /* X-Y */
-            if (0)
-              {
+/**
+ * @brief Feed a batch to auto Y, waterfall and persistence, reduced while overloaded
+ * @param firstKey Key of the batch's first frame
+ * @param batch
+ */
+void MainWindow::showBatch (double firstKey, const SampleBatch &batch)
+{
+    /* Auto Y ranges only cover the X window, older samples are dropped here so
+     * they do not pile up while nothing reads them; a wider window refills */
+    const double windowStart = firstKey + batch.frames - ui->spinPoints->value();
+    rangeWindow = qMin (rangeWindow, ui->spinPoints->value());
 
-              }
-            /* Rolling (v1.0.0 compatible) */
-            else
-              {
-                /* Add data to Graph 0 */
-                ui->plot->graph(channel)->addData (dataPointNumber, newData[channel].toDouble());
-                /* Increment data number and channel */
-                channel++;
-              }
+    for (int g = 0; g < batch.channels.size(); g++)
+      {
+        if (!batch.hasChannel (g))
+          {
+            continue;
           }
 
-        /* Post-parsing */
-        /* X-Y */
-        if (0)
+        /* NaN means "no value in this frame", it is not plotted */
+        overload.select (batch.channels[g], batch.frames, firstKey, plotKeys, plotValues);
+
+        for (int i = 0; i < plotKeys.size(); i++)
           {
+            windowRanges[g].append (plotKeys[i], plotValues[i]);
+          }
+        windowRanges[g].removeBefore (windowStart);
 
+        if (waterfallWindow != nullptr && waterfallWindow->channel() == g)
+          {
+            waterfallWindow->addSamples (plotValues.constData(), plotValues.size());
           }
-        /* Rolling (v1.0.0 compatible) */
-        else
+        if (persistence && plotting && persistenceMaps[g]->visible())                     // Density is drawn as is, hold it while paused
           {
-            dataPointNumber++;
-            channel = 0;
+            for (int i = 0; i < plotKeys.size(); i++)
+              {
+                persistenceMaps[g]->addData (plotKeys[i], plotValues[i]);
+              }
           }
       }
-    you_shall_NOT_PASS = false;
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -475,45 +589,177 @@ void MainWindow::on_spinAxesMax_valueChanged(int arg1)
  */
 void MainWindow::readData()
 {
-    if(serialPort->bytesAvailable()) {                                                    // If any bytes are available
-        QByteArray data = serialPort->readAll();                                          // Read all data in QByteArray
-
-        if(!data.isEmpty()) {                                                             // If the byte array is not empty
-            char *temp = data.data();                                                     // Get a '\0'-terminated char* to the data
+    ReadBuffer *buffer = readBuffers.acquire();
+    if (buffer == nullptr) {                                                              // Pool exhausted: allocate, and say so
+        const QByteArray data = serialPort->readAll();
+        ingest (data.constData(), data.size());
+        ui->statusBar->showMessage (QString ("Read buffers exhausted %1 times").arg (readBuffers.exhausted()));
+        return;
+    }
 
-            if (!filterDisplayedData){
-                ui->textEdit_UartWindow->append(data);
-            }
-            for(int i = 0; temp[i] != '\0'; i++) {                                        // Iterate over the char*
-                switch(STATE) {                                                           // Switch the current state of the message
-                case WAIT_START:                                                          // If waiting for start [$], examine each char
-                    if(temp[i] == START_MSG) {                                            // If the char is $, change STATE to IN_MESSAGE
-                        STATE = IN_MESSAGE;
-                        receivedData.clear();                                             // Clear temporary QString that holds the message
-                        break;                                                            // Break out of the switch
-                    }
-                    break;
-                case IN_MESSAGE:                                                          // If state is IN_MESSAGE
-                    if(temp[i] == END_MSG) {                                              // If char examined is ;, switch state to END_MSG
-                        STATE = WAIT_START;
-                        QStringList incomingData = receivedData.split(' ');               // Split string received from port and put it into list
-                        if(filterDisplayedData){
-                            ui->textEdit_UartWindow->append(receivedData);
-                        }
-                        emit newData(incomingData);                                       // Emit signal for data received with the list
-                        break;
-                    }
-                    else if (isdigit (temp[i]) || isspace (temp[i]) || temp[i] =='-' || temp[i] =='.')
-                      {
-                        /* If examined char is a digit, and not '$' or ';', append it to temporary string */
-                        receivedData.append(temp[i]);
-                      }
-                    break;
-                default: break;
-                }
-            }
+    while (serialPort->bytesAvailable() > 0) {                                            // If any bytes are available
+        buffer->size = int (serialPort->read (buffer->bytes(), buffer->capacity()));      // Read into the pooled buffer
+        if (buffer->size <= 0) {
+            break;
         }
+        ingest (buffer->constBytes(), buffer->size);
     }
+    readBuffers.release (buffer);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Ingest every buffer the reader thread has queued and give it back to the pool
+ */
+void MainWindow::readerData()
+{
+    ReadBuffer *buffer;
+    while (serialReader != nullptr && (buffer = serialReader->take()) != nullptr) {
+        ingest (buffer->constBytes(), buffer->size);
+        readBuffers.release (buffer);
+    }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief The reader thread lost the port
+ * @param error
+ */
+void MainWindow::onReaderFailed (const QString &error)
+{
+    on_actionDisconnect_triggered();
+    ui->statusBar->showMessage ("Port lost: " + error);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Overruns and scheduling delays seen by the reader thread, to check its options
+ */
+void MainWindow::showReaderStatistics()
+{
+    if (serialReader != nullptr)
+      {
+        ui->statusBar->showMessage ("Reader: " + serialReader->statistics().toString());
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief The flight recorder's trigger fired
+ * @param reason
+ */
+void MainWindow::onFlightTriggered (const QString &reason)
+{
+    dumpFlightRecorder (reason);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief A flight recorder dump is on disk
+ * @param fileName
+ * @param ok
+ */
+void MainWindow::onFlightDumped (const QString &fileName, bool ok)
+{
+    ui->statusBar->showMessage (ok ? "Flight recording saved to " + fileName : "Could not write " + fileName);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Write what the flight recorder holds, capture goes on meanwhile
+ * @param reason Shown in the status bar
+ */
+void MainWindow::dumpFlightRecorder (const QString &reason)
+{
+    QStringList names;
+    for (int c = 0; c < pipeline.columnCount(); c++)
+      {
+        names << pipeline.columnName (c);
+      }
+    const QString fileName = FlightRecorder::defaultFileName();
+    if (flightRecorder.dump (fileName, names))
+      {
+        ui->statusBar->showMessage (QString ("Flight recorder (%1): writing the last %2 s to %3").arg (reason).arg (flightRecorder.seconds()).arg (fileName));
+      }
+    else
+      {
+        ui->statusBar->showMessage ("Flight recorder is empty");
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Stop the reader thread, ingest what it still queued and drop it
+ */
+void MainWindow::closeReader()
+{
+    readerTimer.stop();
+    serialReader->close();
+    readerData();
+    ui->statusBar->showMessage ("Reader: " + serialReader->statistics().toString());
+    delete serialReader;
+    serialReader = nullptr;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Show, parse and emit a chunk of received bytes
+ * @param data
+ * @param size
+ */
+void MainWindow::ingest (const char *data, int size)
+{
+    if (size <= 0) {                                                                      // If the chunk is empty
+        return;
+    }
+    overload.begin();
+    flightRecorder.addRaw (data, size);
+
+    const bool showText = !overload.overloaded();                                         // The UART window is the slowest consumer
+    if (!showText) {
+        overload.hideText();
+    }
+    if (!filterDisplayedData && showText){
+        ui->textEdit_UartWindow->append(QString::fromUtf8 (data, size));
+    }
+
+    frameTexts.clear();
+    const int frames = pipeline.feed (data, size, (filterDisplayedData && showText) ? &frameTexts : nullptr);
+
+    foreach (const QString &text, frameTexts) {
+        ui->textEdit_UartWindow->append(text);
+    }
+
+    if (frames > 0) {
+        syncChannels();
+        emit newData(pipeline.batch());                                                   // Emit signal for data received with the batch
+    }
+
+    if (overload.end()) {
+        ui->statusBar->showMessage (overload.toString());
+    }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Add a graph for every pipeline column that does not have one yet
+ *
+ * Columns and graphs share their index. Called once per batch; received
+ * channels show up in groups once the pipeline has settled on the frame
+ * width, so the channel list is redrawn once per group.
+ */
+void MainWindow::syncChannels()
+{
+    if (channels == pipeline.columnCount())
+      {
+        return;
+      }
+    ui->listWidget_Channels->setUpdatesEnabled (false);
+    while (channels < pipeline.columnCount())
+      {
+        addChannel (pipeline.columnName (channels));
+      }
+    ui->listWidget_Channels->setUpdatesEnabled (true);
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -547,10 +793,25 @@ void MainWindow::on_spinYStep_valueChanged(int arg1)
 
 /**
  * @brief Save a PNG image of the plot to current EXE directory
+ *
+ * Only the snapshot is taken here, rasterizing and encoding run in the
+ * background so reading the port is not held up.
  */
 void MainWindow::on_savePNGButton_clicked()
 {
-    ui->plot->savePng (QString::number(dataPointNumber) + ".png", 1920, 1080, 2, 50);
+    plotExport.savePng (ui->plot, QString::number(dataPointNumber) + ".png", 1920, 1080, 2, 50);
+    ui->statusBar->showMessage (QString ("Saving image (%1 pending)").arg (plotExport.pending()));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Report a finished PNG export
+ * @param fileName
+ * @param ok
+ */
+void MainWindow::onPngSaved (const QString &fileName, bool ok)
+{
+    ui->statusBar->showMessage ((ok ? "Saved " : "Cannot write ") + fileName);
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -589,10 +850,9 @@ void MainWindow::on_mouse_wheel_in_plot (QWheelEvent *event)
 void MainWindow::channel_selection (void)
 {
     /* synchronize selection of graphs with selection of corresponding legend items */
-     for (int i = 0; i < ui->plot->graphCount(); i++)
+     for (int i = 0; i < channelViews.size(); i++)
        {
-         QCPGraph *graph = ui->plot->graph(i);
-         QCPPlottableLegendItem *item = ui->plot->legend->itemWithPlottable (graph);
+         QCPPlottableLegendItem *item = ui->plot->legend->itemWithPlottable (channelViews[i]);
          if (item->selected())
            {
              item->setSelected (true);
@@ -625,9 +885,9 @@ void MainWindow::legend_double_click(QCPLegend *legend, QCPAbstractLegendItem *i
         if (ok)
           {
             plItem->plottable()->setName(newName);
-            for(int i=0; i<ui->plot->graphCount(); i++)
+            for(int i=0; i<channelViews.size(); i++)
             {
-                ui->listWidget_Channels->item(i)->setText(ui->plot->graph(i)->name());
+                ui->listWidget_Channels->item(i)->setText(channelViews[i]->name());
             }
             ui->plot->replot();
           }
@@ -642,8 +902,7 @@ void MainWindow::legend_double_click(QCPLegend *legend, QCPAbstractLegendItem *i
 void MainWindow::on_spinPoints_valueChanged (int arg1)
 {
     Q_UNUSED(arg1)
-    ui->plot->xAxis->setRange (dataPointNumber - ui->spinPoints->value(), dataPointNumber);
-    ui->plot->replot();
+    replot();
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -674,6 +933,7 @@ void MainWindow::on_actionConnect_triggered()
           ui->actionConnect->setEnabled (false);
           ui->actionPause_Plot->setEnabled (true);
           ui->statusBar->showMessage ("Plot restarted!");
+          replot();                                                                       // Jump to live data
         }
     }
   else
@@ -722,9 +982,6 @@ void MainWindow::on_actionConnect_triggered()
           stopBits = QSerialPort::TwoStop;
         }
 
-      /* Use local instance of QSerialPort; does not crash */
-      serialPort = new QSerialPort (portInfo, nullptr);
-
       /* Open serial port and connect its signals */
       openPort (portInfo, baudRate, dataBits, parity, stopBits);
   }
@@ -742,7 +999,7 @@ void MainWindow::on_actionPause_Plot_triggered()
       plotting = false;
       ui->actionConnect->setEnabled (true);
       ui->actionPause_Plot->setEnabled (false);
-      ui->statusBar->showMessage ("Plot paused, new data will be ignored");
+      ui->statusBar->showMessage ("Plot paused, new data is still recorded and kept in history");
     }
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -763,6 +1020,544 @@ void MainWindow::on_actionRecord_stream_triggered()
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/**
+ * @brief Open the spectrogram window for the selected channel
+ */
+void MainWindow::on_actionSpectrogram_triggered()
+{
+    int channel = qMax (ui->listWidget_Channels->currentRow(), 0);
+    QString name = QString ("Channel %1").arg (channel);
+    if (channel < channelViews.size())
+      {
+        name = channelViews[channel]->name();
+      }
+
+    if (waterfallWindow == nullptr)
+      {
+        waterfallWindow = new WaterfallWindow (this);
+      }
+    waterfallWindow->setChannel (channel, name);
+    waterfallWindow->show();
+    waterfallWindow->raise();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Toggle persistence (density) display instead of plain lines
+ */
+void MainWindow::on_actionPersistence_triggered()
+{
+    persistence = ui->actionPersistence->isChecked();
+
+    for (int i = 0; i < persistenceMaps.size(); i++)
+      {
+        persistenceMaps[i]->clear();
+      }
+    ui->plot->layer ("persistence")->setVisible (persistence);
+    ui->plot->layer ("main")->setVisible (!persistence);
+
+    if (persistence)
+      {
+        ui->statusBar->showMessage ("Persistence display, X axis is the position inside the sweep");
+      }
+    replot();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Toggle rendering the channels as parallel tiles
+ */
+void MainWindow::on_actionParallel_render_triggered()
+{
+    if (tracePresenter->isEnabled())
+      {
+        tracePresenter->setEnabled (false);                                               // Both would draw the deferred views
+        ui->actionPipelined_render->setChecked (false);
+      }
+    traceCompositor->setEnabled (ui->actionParallel_render->isChecked());
+    ui->statusBar->showMessage (traceCompositor->isEnabled() ? "Channels rendered in parallel" : "Channels rendered one by one");
+    replot();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Options of the thread reading the port: scheduling, core, locked memory, buffer sizes
+ */
+void MainWindow::on_actionReader_thread_triggered()
+{
+    bool ok;
+    const QString spec = QInputDialog::getText (this, "Reader thread",
+                                                "Read the port on its own thread (takes effect on the next connect):\n"
+                                                "thread  fifo:P  rr:P  cpu:N  mlock  lowlatency  buffer:BYTES\n(empty to read on the GUI thread)",
+                                                QLineEdit::Normal, readerSpec, &ok);
+    if (!ok)
+      {
+        return;
+      }
+
+    QString error;
+    if (!ReaderOptions::parse (spec, readerOptions, &error))
+      {
+        ui->statusBar->showMessage (error);
+        return;
+      }
+    readerSpec = spec.trimmed();
+    ui->statusBar->showMessage (readerSpec.isEmpty() ? "Port read on the GUI thread" : "Reader thread: " + readerOptions.toString());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Choose what the display does when data comes faster than it can be shown
+ */
+void MainWindow::on_actionOverload_policy_triggered()
+{
+    bool ok;
+    const QString name = QInputDialog::getItem (this, "Overload policy", "When the display cannot keep up (history and recording keep every sample):",
+                                                OverloadGuard::policyNames(), int (overload.policy()), false, &ok);
+    if (!ok)
+      {
+        return;
+      }
+    overload.setPolicy (OverloadPolicy (OverloadGuard::policyNames().indexOf (name)));
+    ui->statusBar->showMessage (overload.toString());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Span kept by the flight recorder and what makes it dump on its own
+ */
+void MainWindow::on_actionFlight_recorder_triggered()
+{
+    bool ok;
+    const QString spec = QInputDialog::getText (this, "Flight recorder",
+                                                "Keep the last received data in RAM, dump it with F9 or on a trigger:\n"
+                                                "off  seconds:N  minutes:N  megabytes:N  above:CH:LEVEL  below:CH:LEVEL  text:STRING  after:SECONDS",
+                                                QLineEdit::Normal, flightRecorder.options().toString(), &ok);
+    if (!ok)
+      {
+        return;
+      }
+
+    FlightOptions options;
+    QString error;
+    if (!FlightOptions::parse (spec, options, &error))
+      {
+        ui->statusBar->showMessage (error);
+        return;
+      }
+    flightRecorder.setOptions (options);
+    ui->statusBar->showMessage ("Flight recorder: " + options.toString());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Hotkey: dump the flight recorder now
+ */
+void MainWindow::on_actionDump_flight_recorder_triggered()
+{
+    dumpFlightRecorder ("on demand");
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Split recordings into segments by size or duration, and sync them in background
+ */
+void MainWindow::on_actionRecording_segments_triggered()
+{
+    bool ok;
+    const QString spec = QInputDialog::getText (this, "Recording segments",
+                                                "Split or compress the next recordings (off for one CSV file):\n"
+                                                "off  size:BYTES  seconds:N  minutes:N  hours:N  sync:MS  compress[:LEVEL]",
+                                                QLineEdit::Normal, recorder.segments().toString(), &ok);
+    if (!ok)
+      {
+        return;
+      }
+
+    SegmentOptions options;
+    QString error;
+    if (!SegmentOptions::parse (spec, options, &error))
+      {
+        ui->statusBar->showMessage (error);
+        return;
+      }
+    recorder.setSegments (options);
+    ui->statusBar->showMessage ("Recording segments: " + options.toString());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Toggle drawing the channels on a render thread, one frame behind
+ */
+void MainWindow::on_actionPipelined_render_triggered()
+{
+    if (traceCompositor->isEnabled())
+      {
+        traceCompositor->setEnabled (false);
+        ui->actionParallel_render->setChecked (false);
+      }
+    tracePresenter->setEnabled (ui->actionPipelined_render->isChecked());
+    ui->statusBar->showMessage (tracePresenter->isEnabled() ? "Channels rendered off screen, last finished frame shown" : "Channels rendered with the plot");
+    replot();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Edit the filter chain of the selected received channel
+ *
+ * The first non-empty chain adds a "(filtered)" graph next to the raw one.
+ */
+void MainWindow::on_actionFilters_triggered()
+{
+    const int row = ui->listWidget_Channels->currentRow();
+    const int channel = pipeline.channelOfColumn (row);
+    if (channel < 0)
+      {
+        ui->statusBar->showMessage ("Select a received channel to filter");
+        return;
+      }
+
+    bool ok;
+    QString spec = QInputDialog::getText (this, "Channel filters",
+                                          "Stages separated by '|':\nma:N  lp:F,Q  hp:F,Q  biquad:b0,b1,b2,a1,a2  fir:t0,t1,...  dec:N\n(F in cycles/sample)",
+                                          QLineEdit::Normal, pipeline.filterSpec (channel), &ok);
+    if (!ok)
+      {
+        return;
+      }
+
+    QString error;
+    pipeline.setColumnName (row, channelViews[row]->name());
+    if (!pipeline.setFilter (channel, spec, &error))
+      {
+        ui->statusBar->showMessage (error);
+        return;
+      }
+    syncChannels();
+    ui->statusBar->showMessage (pipeline.filterSpec (channel).isEmpty() ? "Filter removed" : "Filter applied");
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Add a channel computed from an expression over the received channels
+ */
+void MainWindow::on_actionMath_channel_triggered()
+{
+    bool ok;
+    QString text = QInputDialog::getText (this, "Math channel",
+                                          "Expression over received channels ch0, ch1, ...\ne.g. ch0 - ch1,  sqrt(ch2^2 + ch3^2),  ch4 * 3.3 / 4096",
+                                          QLineEdit::Normal, QString(), &ok);
+    if (!ok || text.trimmed().isEmpty())
+      {
+        return;
+      }
+
+    QString error;
+    if (!pipeline.addMath (text, &error))
+      {
+        ui->statusBar->showMessage (error);
+        return;
+      }
+
+    syncChannels();
+    ui->statusBar->showMessage ("Math channel added: " + pipeline.columnName (channels - 1));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Toggle the Y axis following the data inside the X window
+ */
+void MainWindow::on_actionAuto_Y_triggered()
+{
+    autoY = ui->actionAuto_Y->isChecked();
+    ui->spinAxesMin->setEnabled (!autoY);
+    ui->spinAxesMax->setEnabled (!autoY);
+    replot();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Choose how the selected channel's samples are stored
+ *
+ * Auto keeps 12/16-bit ADC readings as int16 and widens only when needed,
+ * a fixed type rounds/clamps whatever does not fit.
+ */
+void MainWindow::on_actionStorage_type_triggered()
+{
+    const int row = ui->listWidget_Channels->currentRow();
+    if (row < 0 || row >= channelViews.size())
+      {
+        ui->statusBar->showMessage ("Select a channel to change its storage type");
+        return;
+      }
+
+    const QStringList types = { "int16", "int32", "float", "double", "Auto" };            // In StoreType order
+    bool ok;
+    QString type = QInputDialog::getItem (this, "Storage type", channelViews[row]->name() + " stored as:",
+                                          types, int (store.channelType (channelViews[row]->channel())), false, &ok);
+    if (!ok)
+      {
+        return;
+      }
+    store.setChannelType (channelViews[row]->channel(), StoreType (types.indexOf (type)));
+    ui->statusBar->showMessage (QString ("History: %1 MB").arg (double (store.bytes()) / (1024 * 1024), 0, 'f', 1));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Limit the memory kept for history, the oldest data moves to scrollback files
+ */
+void MainWindow::on_actionHistory_limit_triggered()
+{
+    bool ok;
+    int megabytes = QInputDialog::getInt (this, "History limit", "Memory for history in MB, older data goes to disk (0 = unlimited):",
+                                          int (store.byteBudget() / (1024 * 1024)), 0, 1024 * 1024, 64, &ok);
+    if (!ok)
+      {
+        return;
+      }
+    store.setByteBudget (qint64 (megabytes) * 1024 * 1024);
+    rangeWindow = 0;                                                                      // Window data may be gone
+    ui->statusBar->showMessage (QString ("History: %1 MB in memory, %2 MB on disk").arg (double (store.bytes()) / (1024 * 1024), 0, 'f', 1)
+                                                                                    .arg (double (store.diskBytes()) / (1024 * 1024), 0, 'f', 1));
+    replot();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Ask which part of a recording to load
+ * @param what Shown in the dialog, what the recording is made of
+ * @param begin msecs since epoch of the recording's first data
+ * @param end Of its last data
+ * @param from Set to the start of the chosen range
+ * @param to Set to its end
+ * @return false if canceled or the range is not valid
+ */
+bool MainWindow::askTimeRange (const QString &what, qint64 begin, qint64 end, qint64 &from, qint64 &to)
+{
+    const qint64 total = (end - begin) / 1000;
+    bool ok;
+    const QString range = QInputDialog::getText (this, "Open recording",
+                                                 QString ("%1, %2 s. Seconds from the start to load, as from-to (empty for all):").arg (what).arg (total),
+                                                 QLineEdit::Normal, QString(), &ok);
+    if (!ok)
+      {
+        return false;
+      }
+    from = begin;
+    to = end;
+    if (range.trimmed().isEmpty())
+      {
+        return true;
+      }
+
+    bool fromOk, toOk;
+    const qint64 first = range.section ('-', 0, 0).trimmed().toLongLong (&fromOk);
+    const qint64 last = range.section ('-', 1).trimmed().toLongLong (&toOk);
+    if (!fromOk || !toOk || last < first)
+      {
+        ui->statusBar->showMessage ("Bad range: " + range);
+        return false;
+      }
+    from = begin + first * 1000;
+    to = begin + last * 1000;
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Load a CSV recording for offline viewing, replacing the current data
+ *
+ * Parsing runs in background, frames are added to the plot as they come.
+ */
+void MainWindow::on_actionOpen_CSV_triggered()
+{
+    if (connected)
+      {
+        ui->statusBar->showMessage ("Disconnect before opening a recording");
+        return;
+      }
+
+    QString fileName = QFileDialog::getOpenFileName (this, "Open CSV recording", QString(),
+                                                     "CSV files (*.csv *" PACKED_SUFFIX ");;Segmented recordings (*" SEGMENT_INDEX_SUFFIX ");;All files (*)");
+    if (fileName.isEmpty())
+      {
+        return;
+      }
+
+    /* Segmented and compressed recordings: only the segments and blocks overlapping the asked time range are read */
+    QStringList fileNames (fileName);
+    qint64 firstFrame = 0;
+    qint64 from = 0;
+    qint64 to = Q_INT64_C (0x7fffffffffffffff);
+    if (fileName.endsWith (SEGMENT_INDEX_SUFFIX))
+      {
+        const QVector<SegmentInfo> segments = CsvRecorder::readIndex (fileName);
+        if (segments.isEmpty())
+          {
+            ui->statusBar->showMessage ("Cannot read " + fileName);
+            return;
+          }
+        if (!askTimeRange (QString ("%1 segments").arg (segments.size()), segments.first().start, segments.last().end, from, to))
+          {
+            return;
+          }
+
+        fileNames.clear();
+        for (int i = 0; i < segments.size(); i++)
+          {
+            if (segments[i].end >= from && segments[i].start <= to)
+              {
+                if (fileNames.isEmpty())
+                  {
+                    firstFrame = segments[i].firstFrame;
+                  }
+                fileNames << segments[i].fileName;
+              }
+          }
+      }
+    else if (fileName.endsWith (PACKED_SUFFIX))
+      {
+        const QVector<PackedBlock> blocks = CsvRecorder::readBlocks (fileName);
+        if (blocks.isEmpty())
+          {
+            ui->statusBar->showMessage ("Cannot read " + fileName);
+            return;
+          }
+        if (!askTimeRange (QString ("%1 blocks").arg (blocks.size()), blocks.first().start, blocks.last().end, from, to))
+          {
+            return;
+          }
+      }
+
+    if (csvImporter == nullptr)
+      {
+        csvImporter = new CsvImporter (this);
+        connect (csvImporter, SIGNAL (batchReady(SampleBatch)), this, SLOT (onImportedBatch(SampleBatch)));
+        connect (csvImporter, SIGNAL (progress(int)), this, SLOT (onImportProgress(int)));
+        connect (csvImporter, SIGNAL (finished()), this, SLOT (onImportFinished()));
+        importProgress = new QProgressBar (this);
+        importProgress->setMaximumWidth (200);
+        importProgress->setVisible (false);
+        ui->statusBar->addPermanentWidget (importProgress);
+      }
+
+    on_actionClear_triggered();
+    if (!csvImporter->open (fileNames, from, to))
+      {
+        ui->statusBar->showMessage ("Cannot open " + fileName);
+        return;
+      }
+    /* Keys as they were recorded */
+    dataPointNumber = csvImporter->firstFrame() >= 0 ? csvImporter->firstFrame() : firstFrame;
+    QStringList names = csvImporter->header();
+    for (int i = 0; i < names.size(); i++)
+      {
+        pipeline.addChannel (names[i]);
+      }
+    syncChannels();
+    importProgress->setValue (0);
+    importProgress->setVisible (true);
+    ui->statusBar->showMessage ("Loading " + fileName);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Frames parsed from the recording, same path as received ones minus recording
+ * @param newData Raw columns
+ */
+void MainWindow::onImportedBatch (const SampleBatch &newData)
+{
+    pipeline.process (newData);
+    syncChannels();
+    store.append (dataPointNumber, pipeline.batch());
+    dataPointNumber += newData.frames;
+    rangeWindow = 0;                                                                      // Window extremes were not fed
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Show the loading progress and what is loaded so far
+ * @param percent
+ */
+void MainWindow::onImportProgress (int percent)
+{
+    importProgress->setValue (percent);
+    replot();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Recording fully loaded
+ */
+void MainWindow::onImportFinished()
+{
+    importProgress->setVisible (false);
+    ui->statusBar->showMessage (QString ("Loaded %1 frames").arg (dataPointNumber));
+    replot();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Y extremes of the visible graphs between the X window start and the newest point
+ *
+ * Each graph keeps a SlidingMinMax fed at ingest, so this only slides the
+ * window start instead of rescanning the graph data. Samples older than the
+ * window are dropped for good, so a wider window refills them once from the
+ * graph data.
+ * @param lower Minimum found
+ * @param upper Maximum found
+ * @return false if there is no visible sample in the window
+ */
+bool MainWindow::windowRange (double &lower, double &upper)
+{
+    const double windowStart = dataPointNumber - ui->spinPoints->value();
+
+    if (ui->spinPoints->value() > rangeWindow)
+      {
+        for (int g = 0; g < windowRanges.size(); g++)
+          {
+            windowRanges[g].clear();
+            for (int b = store.findBlock (windowStart); b < store.blockCount(); b++)
+              {
+                const StoreBlock &block = store.block (b);
+                if (block.values[g].isEmpty())
+                  {
+                    continue;
+                  }
+                plotValues.resize (block.frames);
+                block.values[g].read (0, block.frames, plotValues.data());
+                for (int f = 0; f < block.frames; f++)
+                  {
+                    windowRanges[g].append (block.key (f), plotValues[f]);
+                  }
+              }
+          }
+      }
+    rangeWindow = ui->spinPoints->value();
+
+    bool found = false;
+    for (int g = 0; g < windowRanges.size(); g++)
+      {
+        windowRanges[g].removeBefore (windowStart);
+        if (!channelViews[g]->visible() || windowRanges[g].isEmpty())
+          {
+            continue;
+          }
+        if (!found || windowRanges[g].minimum() < lower)
+          {
+            lower = windowRanges[g].minimum();
+          }
+        if (!found || windowRanges[g].maximum() > upper)
+          {
+            upper = windowRanges[g].maximum();
+          }
+        found = true;
+      }
+    return found;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /**
  * @brief Closes COM port and stop plotting
  */
@@ -770,7 +1565,14 @@ void MainWindow::on_actionDisconnect_triggered()
 {
   if (connected)
     {
-      serialPort->close();                                                              // Close serial port
+      if (serialReader != nullptr)
+        {
+          closeReader();                                                                // Reader thread owns the port
+        }
+      if (serialPort != nullptr)                                                        // Not created with a reader
+        {
+          serialPort->close();                                                          // Close serial port
+        }
       emit portClosed();                                                                // Notify application
       delete serialPort;                                                                // Delete the pointer
       serialPort = nullptr;                                                                // Assign NULL to dangling pointer
@@ -784,7 +1586,12 @@ void MainWindow::on_actionDisconnect_triggered()
       ui->actionPause_Plot->setEnabled (false);
       ui->actionDisconnect->setEnabled (false);
       ui->actionRecord_stream->setEnabled(true);
-      receivedData.clear();                                                             // Clear received string
+      if (pipeline.flush() > 0)                                                         // Frames of a format still being detected
+        {
+          syncChannels();
+          emit newData (pipeline.batch());
+        }
+      pipeline.reset();                                                                 // Drop any partial message
 
       ui->savePNGButton->setEnabled (false);
       enable_com_controls (true);
@@ -799,10 +1606,26 @@ void MainWindow::on_actionDisconnect_triggered()
  */
 void MainWindow::on_actionClear_triggered()
 {
+    if (csvImporter != nullptr)
+      {
+        csvImporter->cancel();
+        importProgress->setVisible (false);
+      }
     ui->plot->clearPlottables();
+    store.clear();
+    channelViews.clear();
+    persistenceMaps.clear();
+    windowRanges.clear();
     ui->listWidget_Channels->clear();
+    pipeline.clear();
+    overload.clear();
+    flightRecorder.clear();
     channels = 0;
     dataPointNumber = 0;
+    if (waterfallWindow != nullptr)
+      {
+        waterfallWindow->clear();
+      }
     emit setupPlot();
     ui->plot->replot();
 }
@@ -814,12 +1637,8 @@ void MainWindow::on_actionClear_triggered()
  */
 void MainWindow::openCsvFile(void)
 {
-  m_csvFile = new QFile(QDateTime::currentDateTime().toString("yyyy-MM-d-HH-mm-ss-")+"data-out.csv");
-  if(!m_csvFile)
-      return;
-  if (!m_csvFile->open(QIODevice::ReadWrite | QIODevice::Text))
-        return;
-  
+  if (!recorder.open (CsvRecorder::defaultFileName()))
+      ui->statusBar->showMessage ("Cannot create " + recorder.fileName());
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -829,31 +1648,21 @@ void MainWindow::openCsvFile(void)
  */
 void MainWindow::closeCsvFile(void)
 {
-  if(!m_csvFile) return;
-  m_csvFile->close();
-  if(m_csvFile) delete m_csvFile;
-  m_csvFile = nullptr;
+  recorder.close();
 }
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /**
- * @brief Open a new CSV file to save received data
+ * @brief Save the received batch to the opened CSV file, one line per frame
  *
  */
-void MainWindow::saveStream(QStringList newData)
+void MainWindow::saveStream(const SampleBatch &newData)
 {
-  if(!m_csvFile)
-    return;
   if(ui->actionRecord_stream->isChecked())
   {
-      QTextStream out(m_csvFile);
-      foreach (const QString &str, newData) {
-        out << str << ",";
-      }
-      out << "\n";
+      recorder.write (newData);
   }
 }
-
 /** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void MainWindow::on_pushButton_TextEditHide_clicked()
@@ -886,16 +1695,20 @@ void MainWindow::on_pushButton_ShowallData_clicked()
 
 void MainWindow::on_pushButton_AutoScale_clicked()
 {
-    ui->plot->yAxis->rescale(true);
-    ui->spinAxesMax->setValue(int(ui->plot->yAxis->range().upper) + int(ui->plot->yAxis->range().upper*0.1));
-    ui->spinAxesMin->setValue(int(ui->plot->yAxis->range().lower) + int(ui->plot->yAxis->range().lower*0.1));
+    double lower, upper;
+    if (!windowRange (lower, upper))
+    {
+        return;
+    }
+    ui->spinAxesMax->setValue(int(upper) + int(upper*0.1));
+    ui->spinAxesMin->setValue(int(lower) + int(lower*0.1));
 }
 
 void MainWindow::on_pushButton_ResetVisible_clicked()
 {
-    for(int i=0; i<ui->plot->graphCount(); i++)
+    for(int i=0; i<channelViews.size(); i++)
     {
-        ui->plot->graph(i)->setVisible(true);
+        channelViews[i]->setVisible(true);
         ui->listWidget_Channels->item(i)->setBackground(Qt::NoBrush);
     }
 }
@@ -904,14 +1717,14 @@ void MainWindow::on_listWidget_Channels_itemDoubleClicked(QListWidgetItem *item)
 {
     int graphIdx = ui->listWidget_Channels->currentRow();
 
-    if(ui->plot->graph(graphIdx)->visible())
+    if(channelViews[graphIdx]->visible())
     {
-        ui->plot->graph(graphIdx)->setVisible(false);
+        channelViews[graphIdx]->setVisible(false);
         item->setBackgroundColor(Qt::black);
     }
     else
     {
-        ui->plot->graph(graphIdx)->setVisible(true);
+        channelViews[graphIdx]->setVisible(true);
         item->setBackground(Qt::NoBrush);
     }
     ui->plot->replot();
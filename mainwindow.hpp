@@ -30,16 +30,26 @@
 #include <QMainWindow>
 #include <QtSerialPort/QtSerialPort>
 #include <QSerialPortInfo>
+#include <QFileDialog>
+#include <QProgressBar>
 #include "helpwindow.hpp"
+#include "waterfallwindow.hpp"
+#include "persistence.hpp"
+#include "slidingminmax.hpp"
+#include "channelstore.hpp"
+#include "channelview.hpp"
+#include "ingestpipeline.hpp"
+#include "csvimporter.hpp"
+#include "csvrecorder.hpp"
+#include "plotexport.hpp"
+#include "bufferpool.hpp"
+#include "serialreader.hpp"
+#include "overloadguard.hpp"
+#include "flightrecorder.hpp"
+#include "tracecompositor.hpp"
+#include "tracepresenter.hpp"
 #include "qcustomplot/qcustomplot.h"
 
-#define START_MSG       '$'
-#define END_MSG         ';'
-
-#define WAIT_START      1
-#define IN_MESSAGE      2
-#define UNDEFINED       3
-
 #define CUSTOM_LINE_COLORS   14
 #define GCP_CUSTOM_LINE_COLORS 4
 
@@ -61,8 +71,8 @@ private slots:
     void portOpenedFail();                                                                // Called when port fails to open
     void onPortClosed();                                                                  // Called when closing the port
     void replot();                                                                        // Slot for repainting the plot
-    void onNewDataArrived(QStringList newData);                                           // Slot for new data from serial port
-    void saveStream(QStringList newData);                                                 // Save the received data to the opened file
+    void onNewDataArrived(const SampleBatch &newData);                                    // Slot for new data from serial port
+    void saveStream(const SampleBatch &newData);                                          // Save the received data to the opened file
     void on_spinAxesMin_valueChanged(int arg1);                                           // Changing lower limit for the plot
     void on_spinAxesMax_valueChanged(int arg1);                                           // Changing upper limit for the plot
     void readData();                                                                      // Slot for inside serial port
@@ -72,6 +82,15 @@ private slots:
     void onMouseMoveInPlot (QMouseEvent *event);                                          // Displays coordinates of mouse pointer when clicked in plot in status bar
     void on_spinPoints_valueChanged (int arg1);                                           // Spin box controls how many data points are collected and displayed
     void on_mouse_wheel_in_plot (QWheelEvent *event);                                     // Makes wheel mouse works while plotting
+    void onImportedBatch (const SampleBatch &newData);                                    // Frames loaded from a CSV recording
+    void onImportProgress (int percent);
+    void onImportFinished();
+    void onPngSaved (const QString &fileName, bool ok);                                   // Background export is done
+    void readerData();                                                                    // Buffers filled by the reader thread
+    void onReaderFailed (const QString &error);
+    void showReaderStatistics();
+    void onFlightTriggered (const QString &reason);
+    void onFlightDumped (const QString &fileName, bool ok);
 
     /* Used when a channel is selected (plot or legend) */
     void channel_selection (void);
@@ -83,6 +102,21 @@ private slots:
     void on_actionPause_Plot_triggered();
     void on_actionClear_triggered();
     void on_actionRecord_stream_triggered();
+    void on_actionSpectrogram_triggered();
+    void on_actionPersistence_triggered();
+    void on_actionFilters_triggered();
+    void on_actionMath_channel_triggered();
+    void on_actionAuto_Y_triggered();
+    void on_actionStorage_type_triggered();
+    void on_actionHistory_limit_triggered();
+    void on_actionParallel_render_triggered();
+    void on_actionPipelined_render_triggered();
+    void on_actionReader_thread_triggered();
+    void on_actionOverload_policy_triggered();
+    void on_actionFlight_recorder_triggered();
+    void on_actionDump_flight_recorder_triggered();
+    void on_actionRecording_segments_triggered();
+    void on_actionOpen_CSV_triggered();
 
     void on_pushButton_TextEditHide_clicked();
 
@@ -100,7 +134,7 @@ signals:
     void portOpenFail();                                                                  // Emitted when cannot open port
     void portOpenOK();                                                                    // Emitted when port is open
     void portClosed();                                                                    // Emitted when port is closed
-    void newData(QStringList data);                                                       // Emitted when new data has arrived
+    void newData(const SampleBatch &data);                                                // Emitted when new data has arrived
 
 private:
     Ui::MainWindow *ui;
@@ -112,7 +146,7 @@ private:
     /* Main info */
     bool connected;                                                                       // Status connection variable
     bool plotting;                                                                        // Status plotting variable
-    int dataPointNumber;                                                                  // Keep track of data points
+    qint64 dataPointNumber;                                                               // Keep track of data points
     /* Channels of data (number of graphs) */
     int channels;
 
@@ -127,22 +161,53 @@ private:
     QStringList     channelStrList;
 
     //-- CSV file to save data
-    QFile* m_csvFile = nullptr;
+    CsvRecorder recorder;
     void openCsvFile(void);
     void closeCsvFile(void);
 
     QTimer updateTimer;                                                                   // Timer used for replotting the plot
+    QTimer readerTimer;                                                                   // Reader statistics in the status bar
     QTime timeOfFirstData;                                                                // Record the time of the first data point
     double timeBetweenSamples;                                                            // Store time between samples
     QSerialPort *serialPort;                                                              // Serial port; runs in this thread
-    QString receivedData;                                                                 // Used for reading from the port
-    int STATE;                                                                            // State of recieiving message from port
+    IngestPipeline pipeline;                                                              // Parse, filter and math stages; one column per graph
+    ChannelStore store;                                                                   // History of every graph, one shared key column
+    QVector<ChannelView*> channelViews;                                                   // Graphs drawing the store, one per pipeline column
+    QVector<double> plotKeys;                                                             // Scratch for the per graph consumers
+    QVector<double> plotValues;
     int NUMBER_OF_POINTS;                                                                 // Number of points plotted
     HelpWindow *helpWindow;
+    WaterfallWindow *waterfallWindow = nullptr;                                           // Spectrogram of the selected channel
+    QVector<PersistenceMap*> persistenceMaps;                                             // Density display, one per channel
+    bool persistence = false;                                                             // Persistence mode replaces the lines
+    QVector<SlidingMinMax> windowRanges;                                                  // Extremes inside the X window, one per graph
+    int rangeWindow = 0;                                                                  // Window width windowRanges were filled for
+    bool autoY = false;                                                                   // Y axis follows the visible window
+    CsvImporter *csvImporter = nullptr;                                                   // Loads recordings for offline viewing
+    QProgressBar *importProgress = nullptr;
+    PlotExport plotExport;                                                                // PNG snapshots encoded off the GUI thread
+    BufferPool readBuffers;                                                               // Preallocated serial read buffers
+    QStringList frameTexts;                                                               // Text of the parsed messages, for the UART window
+    SerialReader *serialReader = nullptr;                                                 // Reads the port instead of serialPort when readerSpec is set
+    QString readerSpec;                                                                   // Empty: the port is read on the GUI thread
+    ReaderOptions readerOptions;
+    OverloadGuard overload;                                                               // Reduces the display work when it cannot keep up
+    SampleBatch deferredBatch;                                                            // Scratch for batches the guard deferred
+    FlightRecorder flightRecorder;                                                        // Last minutes of raw and decoded data, dumped on demand
+    TraceCompositor *traceCompositor = nullptr;                                           // Parallel per channel rasterization, opt-in
+    TracePresenter *tracePresenter = nullptr;                                             // Traces drawn on a render thread, opt-in
 
     void createUI();                                                                      // Populate the controls
     void enable_com_controls (bool enable);                                               // Enable/disable controls
     void setupPlot();                                                                     // Setup the QCustomPlot
+    int addChannel (const QString &name);                                                 // New graph, legend and list entry; returns its index
+    void syncChannels();                                                                  // Graphs for new pipeline columns
+    void ingest (const char *data, int size);                                             // One chunk of received bytes
+    void closeReader();
+    void showBatch (double firstKey, const SampleBatch &batch);                           // Feed the per graph display consumers
+    void dumpFlightRecorder (const QString &reason);
+    bool askTimeRange (const QString &what, qint64 begin, qint64 end, qint64 &from, qint64 &to);
+    bool windowRange (double &lower, double &upper);                                      // Y extremes of the visible graphs in the X window
                                                                                           // Open the inside serial port with these parameters
     void openPort(QSerialPortInfo portInfo, int baudRate, QSerialPort::DataBits dataBits, QSerialPort::Parity parity, QSerialPort::StopBits stopBits);
 };
@@ -0,0 +1,459 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "mathchannel.hpp"
+#include <QtMath>
+#include <QtNumeric>
+#include <cstring>
+
+/* Column loops for the evaluator, 'a' is the stack top (or the one below for binary ops) */
+#define MATH_UNARY(expr)                                                                  \
+  {                                                                                       \
+    double *a = stack[top].data();                                                        \
+    for (int f = 0; f < frames; f++) { a[f] = (expr); }                                   \
+  }
+#define MATH_BINARY(expr)                                                                 \
+  {                                                                                       \
+    double *a = stack[top - 1].data();                                                    \
+    const double *b = stack[top].data();                                                  \
+    for (int f = 0; f < frames; f++) { a[f] = (expr); }                                   \
+    top--;                                                                                \
+  }
+
+/**
+ * @brief Constructor
+ */
+MathExpression::MathExpression() :
+  stackDepth (0),
+  highestChannel (-1),
+  pos (0),
+  depth (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Compile an expression; the previous program is kept on error
+ * @param expression
+ * @param error Optional, filled with the reason and position of a failure
+ * @return true on success
+ */
+bool MathExpression::compile (const QString &expression, QString *error)
+{
+    QVector<Instruction> previousProgram = program;
+    const int previousDepth = stackDepth;
+    const int previousHighest = highestChannel;
+
+    input = expression;
+    pos = 0;
+    depth = 0;
+    stackDepth = 0;
+    highestChannel = -1;
+    program.clear();
+    failure.clear();
+
+    bool ok = parseExpression();
+    skipSpaces();
+    if (ok && pos < input.size())
+      {
+        ok = fail ("Unexpected character");
+      }
+
+    if (!ok)
+      {
+        if (error != nullptr)
+          {
+            *error = failure;
+          }
+        program = previousProgram;
+        stackDepth = previousDepth;
+        highestChannel = previousHighest;
+        return false;
+      }
+
+    source = expression.trimmed();
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Run the program over one batch
+ * @param channels Column of each received channel, nullptr when not in this batch
+ * @param frames Values per column
+ * @param out Result column, NaN wherever an input was missing
+ */
+void MathExpression::evaluate (const QVector<const double*> &channels, int frames, QVector<double> &out)
+{
+    out.resize (frames);
+    if (program.isEmpty())
+      {
+        out.fill (qQNaN());
+        return;
+      }
+
+    if (stack.size() < stackDepth)
+      {
+        stack.resize (stackDepth);
+      }
+    for (int s = 0; s < stackDepth; s++)
+      {
+        stack[s].resize (frames);
+      }
+
+    int top = -1;
+    for (int i = 0; i < program.size(); i++)
+      {
+        const Instruction &ins = program[i];
+        switch (ins.op)
+          {
+          case OpConst:
+            top++;
+            MATH_UNARY (ins.constant)
+            break;
+          case OpChannel:
+            {
+              top++;
+              const double *column = ins.channel < channels.size() ? channels[ins.channel] : nullptr;
+              if (column != nullptr)
+                {
+                  memcpy (stack[top].data(), column, size_t (frames) * sizeof (double));
+                }
+              else
+                {
+                  MATH_UNARY (qQNaN())
+                }
+            }
+            break;
+          case OpAdd:   MATH_BINARY (a[f] + b[f])                 break;
+          case OpSub:   MATH_BINARY (a[f] - b[f])                 break;
+          case OpMul:   MATH_BINARY (a[f] * b[f])                 break;
+          case OpDiv:   MATH_BINARY (a[f] / b[f])                 break;
+          case OpPow:   MATH_BINARY (qPow (a[f], b[f]))           break;
+          case OpMin:   MATH_BINARY (qMin (a[f], b[f]))           break;
+          case OpMax:   MATH_BINARY (qMax (a[f], b[f]))           break;
+          case OpAtan2: MATH_BINARY (qAtan2 (a[f], b[f]))         break;
+          case OpNeg:   MATH_UNARY (-a[f])                        break;
+          case OpSqrt:  MATH_UNARY (qSqrt (a[f]))                 break;
+          case OpAbs:   MATH_UNARY (qAbs (a[f]))                  break;
+          case OpExp:   MATH_UNARY (qExp (a[f]))                  break;
+          case OpLog:   MATH_UNARY (qLn (a[f]))                   break;
+          case OpLog10: MATH_UNARY (std::log10 (a[f]))            break;
+          case OpSin:   MATH_UNARY (qSin (a[f]))                  break;
+          case OpCos:   MATH_UNARY (qCos (a[f]))                  break;
+          case OpTan:   MATH_UNARY (qTan (a[f]))                  break;
+          }
+      }
+
+    memcpy (out.data(), stack[0].constData(), size_t (frames) * sizeof (double));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Append one instruction and track the stack depth it needs
+ */
+void MathExpression::emitOp (OpCode op, double constant, int channel)
+{
+    Instruction ins;
+    ins.op = op;
+    ins.constant = constant;
+    ins.channel = channel;
+    program.append (ins);
+
+    if (op == OpConst || op == OpChannel)
+      {
+        depth++;
+        stackDepth = qMax (stackDepth, depth);
+      }
+    else if (op == OpAdd || op == OpSub || op == OpMul || op == OpDiv || op == OpPow
+             || op == OpMin || op == OpMax || op == OpAtan2)
+      {
+        depth--;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void MathExpression::skipSpaces()
+{
+    while (pos < input.size() && input[pos].isSpace())
+      {
+        pos++;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool MathExpression::fail (const QString &message)
+{
+    if (failure.isEmpty())
+      {
+        failure = QString ("%1 at position %2").arg (message).arg (pos + 1);
+      }
+    return false;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief expression := term (('+' | '-') term)*
+ */
+bool MathExpression::parseExpression()
+{
+    if (!parseTerm())
+      {
+        return false;
+      }
+    for (;;)
+      {
+        skipSpaces();
+        if (pos >= input.size() || (input[pos] != '+' && input[pos] != '-'))
+          {
+            return true;
+          }
+        const OpCode op = (input[pos++] == '+') ? OpAdd : OpSub;
+        if (!parseTerm())
+          {
+            return false;
+          }
+        emitOp (op);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief term := unary (('*' | '/') unary)*
+ */
+bool MathExpression::parseTerm()
+{
+    if (!parseUnary())
+      {
+        return false;
+      }
+    for (;;)
+      {
+        skipSpaces();
+        if (pos >= input.size() || (input[pos] != '*' && input[pos] != '/'))
+          {
+            return true;
+          }
+        const OpCode op = (input[pos++] == '*') ? OpMul : OpDiv;
+        if (!parseUnary())
+          {
+            return false;
+          }
+        emitOp (op);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief unary := ('-' | '+') unary | power
+ */
+bool MathExpression::parseUnary()
+{
+    skipSpaces();
+    if (pos < input.size() && input[pos] == '-')
+      {
+        pos++;
+        if (!parseUnary())
+          {
+            return false;
+          }
+        emitOp (OpNeg);
+        return true;
+      }
+    if (pos < input.size() && input[pos] == '+')
+      {
+        pos++;
+        return parseUnary();
+      }
+    return parsePower();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief power := primary ('^' unary)?   (right associative)
+ */
+bool MathExpression::parsePower()
+{
+    if (!parsePrimary())
+      {
+        return false;
+      }
+    skipSpaces();
+    if (pos < input.size() && input[pos] == '^')
+      {
+        pos++;
+        if (!parseUnary())
+          {
+            return false;
+          }
+        emitOp (OpPow);
+      }
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief primary := number | chN | pi | e | function '(' args ')' | '(' expression ')'
+ */
+bool MathExpression::parsePrimary()
+{
+    skipSpaces();
+    if (pos >= input.size())
+      {
+        return fail ("Unexpected end of expression");
+      }
+
+    const QChar c = input[pos];
+
+    /* Number */
+    if (c.isDigit() || c == '.')
+      {
+        const int start = pos;
+        while (pos < input.size() && (input[pos].isDigit() || input[pos] == '.'))
+          {
+            pos++;
+          }
+        if (pos < input.size() && (input[pos] == 'e' || input[pos] == 'E'))
+          {
+            pos++;
+            if (pos < input.size() && (input[pos] == '-' || input[pos] == '+'))
+              {
+                pos++;
+              }
+            while (pos < input.size() && input[pos].isDigit())
+              {
+                pos++;
+              }
+          }
+        bool ok;
+        const double value = input.mid (start, pos - start).toDouble (&ok);
+        if (!ok)
+          {
+            pos = start;
+            return fail ("Bad number");
+          }
+        emitOp (OpConst, value);
+        return true;
+      }
+
+    /* Parenthesis */
+    if (c == '(')
+      {
+        pos++;
+        if (!parseExpression())
+          {
+            return false;
+          }
+        skipSpaces();
+        if (pos >= input.size() || input[pos] != ')')
+          {
+            return fail ("Missing ')'");
+          }
+        pos++;
+        return true;
+      }
+
+    if (!c.isLetter())
+      {
+        return fail ("Unexpected character");
+      }
+
+    /* Identifier */
+    const int start = pos;
+    while (pos < input.size() && (input[pos].isLetterOrNumber() || input[pos] == '_'))
+      {
+        pos++;
+      }
+    const QString name = input.mid (start, pos - start).toLower();
+
+    if (name.startsWith ("ch") && name.size() > 2)
+      {
+        bool ok;
+        const int channel = name.mid (2).toInt (&ok);
+        if (ok && channel >= 0)
+          {
+            highestChannel = qMax (highestChannel, channel);
+            emitOp (OpChannel, 0, channel);
+            return true;
+          }
+      }
+    if (name == "pi")
+      {
+        emitOp (OpConst, M_PI);
+        return true;
+      }
+    if (name == "e")
+      {
+        emitOp (OpConst, M_E);
+        return true;
+      }
+
+    struct Function { const char *name; OpCode op; int arity; };
+    static const Function functions[] = {
+        { "sqrt", OpSqrt, 1 }, { "abs", OpAbs, 1 }, { "exp", OpExp, 1 }, { "log", OpLog, 1 },
+        { "log10", OpLog10, 1 }, { "sin", OpSin, 1 }, { "cos", OpCos, 1 }, { "tan", OpTan, 1 },
+        { "min", OpMin, 2 }, { "max", OpMax, 2 }, { "atan2", OpAtan2, 2 }
+    };
+    for (size_t i = 0; i < sizeof (functions) / sizeof (functions[0]); i++)
+      {
+        if (name != functions[i].name)
+          {
+            continue;
+          }
+        skipSpaces();
+        if (pos >= input.size() || input[pos] != '(')
+          {
+            return fail ("Missing '(' after " + name);
+          }
+        pos++;
+        for (int arg = 0; arg < functions[i].arity; arg++)
+          {
+            if (arg > 0)
+              {
+                skipSpaces();
+                if (pos >= input.size() || input[pos] != ',')
+                  {
+                    return fail ("Missing ',' in " + name);
+                  }
+                pos++;
+              }
+            if (!parseExpression())
+              {
+                return false;
+              }
+          }
+        skipSpaces();
+        if (pos >= input.size() || input[pos] != ')')
+          {
+            return fail ("Missing ')' after " + name + " arguments");
+          }
+        pos++;
+        emitOp (functions[i].op);
+        return true;
+      }
+
+    pos = start;
+    return fail ("Unknown name '" + name + "'");
+}
@@ -0,0 +1,91 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef MATHCHANNEL_HPP
+#define MATHCHANNEL_HPP
+
+#include <QVector>
+#include <QString>
+
+/**
+ * @brief Arithmetic expression over received channels, compiled to bytecode
+ *
+ * "ch0 - ch1", "sqrt(ch2^2 + ch3^2)", "ch4 * 3.3 / 4096"... are compiled
+ * once into a postfix program. Evaluation runs the program over whole
+ * columns: every instruction is a tight loop over all frames of the batch,
+ * so the per-sample cost is a few arithmetic operations, not an interpreter
+ * dispatch.
+ *
+ * Operators: + - * / ^ (power), unary minus, parentheses
+ * Functions: sqrt abs exp log log10 sin cos tan min(a,b) max(a,b) atan2(y,x)
+ * Constants: pi e, numbers; chN is received channel N
+ */
+class MathExpression
+{
+public:
+    MathExpression();
+
+    bool compile (const QString &expression, QString *error = nullptr);
+    QString text() const { return source; }
+    int maxChannel() const { return highestChannel; }                                     // -1 if no channel is used
+
+    /* 'channels[n]' is the column of channel n ('frames' values) or nullptr if missing */
+    void evaluate (const QVector<const double*> &channels, int frames, QVector<double> &out);
+
+private:
+    enum OpCode { OpConst, OpChannel, OpAdd, OpSub, OpMul, OpDiv, OpPow, OpNeg,
+                  OpSqrt, OpAbs, OpExp, OpLog, OpLog10, OpSin, OpCos, OpTan,
+                  OpMin, OpMax, OpAtan2 };
+    struct Instruction
+    {
+        OpCode op;
+        double constant;
+        int channel;
+    };
+
+    QString source;
+    QVector<Instruction> program;
+    int stackDepth;
+    int highestChannel;
+    QVector<QVector<double> > stack;
+
+    /* Recursive descent compiler state */
+    QString input;
+    int pos;
+    QString failure;
+    int depth;
+
+    void emitOp (OpCode op, double constant = 0, int channel = 0);
+    void skipSpaces();
+    bool parseExpression();
+    bool parseTerm();
+    bool parseUnary();
+    bool parsePower();
+    bool parsePrimary();
+    bool fail (const QString &message);
+};
+
+#endif // MATHCHANNEL_HPP
@@ -0,0 +1,319 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "overloadguard.hpp"
+#include <QStringList>
+#include <QtNumeric>
+#include <QtMath>
+#include <cstring>
+
+/**
+ * @brief Copy the frames of a batch into columns that keep their capacity
+ *
+ * Assigning would share the columns with the source, and the next write to
+ * either side would allocate a copy of them.
+ * @param from
+ * @param to
+ */
+static void copyBatch (const SampleBatch &from, SampleBatch &to)
+{
+    to.clear();
+    if (to.channels.size() < from.channels.size())
+      {
+        to.channels.resize (from.channels.size());
+      }
+    for (int c = 0; c < from.channels.size(); c++)
+      {
+        if (from.hasChannel (c))
+          {
+            to.channels[c].resize (from.frames);
+            memcpy (to.channels[c].data(), from.channels[c].constData(), from.frames * sizeof (double));
+          }
+      }
+    to.frames = from.frames;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor, policy off
+ */
+OverloadGuard::OverloadGuard() :
+  current (OverloadOff),
+  reduction (1),
+  periodStart (0),
+  busy (0),
+  workStart (0),
+  deferred (OVERLOAD_QUEUE),
+  deferredFirst (0),
+  deferredCount (0),
+  reduced (0),
+  skipped (0),
+  hiddenTexts (0)
+{
+    clock.start();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Change the policy, starting again at full rate
+ * @param newPolicy
+ */
+void OverloadGuard::setPolicy (OverloadPolicy newPolicy)
+{
+    current = newPolicy;
+    reduction = 1;
+    periodStart = clock.nsecsElapsed();
+    busy = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Names for the policy dialog
+ * @return
+ */
+QStringList OverloadGuard::policyNames()
+{
+    return { "Off", "Decimate for display", "Drop oldest batches", "Min/max decimation" };
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Start timing a piece of display work
+ */
+void OverloadGuard::begin()
+{
+    workStart = clock.nsecsElapsed();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Stop timing, and at the end of a period adapt the factor to the busy share
+ * @return true when the factor changed
+ */
+bool OverloadGuard::end()
+{
+    const qint64 now = clock.nsecsElapsed();
+    busy += now - workStart;
+
+    const qint64 period = now - periodStart;
+    if (period < qint64 (OVERLOAD_PERIOD_MS) * 1000000)
+      {
+        return false;
+      }
+    const double load = double (busy) / double (period);
+    periodStart = now;
+    busy = 0;
+    if (current == OverloadOff)
+      {
+        return false;
+      }
+
+    const int previous = reduction;
+    if (load > OVERLOAD_HIGH)
+      {
+        reduction = qMin (reduction * 2, OVERLOAD_MAX_FACTOR);
+      }
+    else if (load < OVERLOAD_LOW)
+      {
+        reduction = qMax (reduction / 2, 1);
+      }
+    return reduction != previous;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Samples of one column for the display consumers
+ *
+ * Decimation keeps the samples whose key is a multiple of the factor, so
+ * the choice does not depend on how the data was split into batches.
+ * Min/max keeps the lowest and the highest sample of every bucket of
+ * 2 x factor keys, in key order, so peaks survive the reduction.
+ * @param column Values, NaN for frames without one
+ * @param frames
+ * @param firstKey Key of the first frame
+ * @param keys Replaced with the selected keys
+ * @param values Replaced with the selected values
+ */
+void OverloadGuard::select (const QVector<double> &column, int frames, double firstKey, QVector<double> &keys, QVector<double> &values)
+{
+    keys.resize (0);
+    values.resize (0);
+    const int step = (current == OverloadDecimate || current == OverloadMinMax) ? reduction : 1;
+    int present = 0;
+
+    if (step == 1)
+      {
+        for (int f = 0; f < frames; f++)
+          {
+            if (!qIsNaN (column[f]))
+              {
+                keys.append (firstKey + f);
+                values.append (column[f]);
+              }
+          }
+        return;
+      }
+
+    if (current == OverloadDecimate)
+      {
+        for (int f = 0; f < frames; f++)
+          {
+            if (qIsNaN (column[f]))
+              {
+                continue;
+              }
+            present++;
+            if (qint64 (firstKey + f) % step == 0)
+              {
+                keys.append (firstKey + f);
+                values.append (column[f]);
+              }
+          }
+        reduced += present - keys.size();
+        return;
+      }
+
+    /* Min/max buckets, a bucket cut by the batch end is closed early */
+    const qint64 width = qint64 (step) * 2;
+    qint64 bucket = -1;
+    int low = -1;
+    int high = -1;
+    for (int f = 0; f <= frames; f++)
+      {
+        const qint64 index = f < frames ? qint64 (firstKey + f) / width : -2;
+        if (index != bucket && low >= 0)
+          {
+            const int first = qMin (low, high);
+            const int second = qMax (low, high);
+            keys.append (firstKey + first);
+            values.append (column[first]);
+            if (second != first)
+              {
+                keys.append (firstKey + second);
+                values.append (column[second]);
+              }
+            low = -1;
+            high = -1;
+          }
+        if (f == frames)
+          {
+            break;
+          }
+        bucket = index;
+        if (qIsNaN (column[f]))
+          {
+            continue;
+          }
+        present++;
+        if (low < 0 || column[f] < column[low])
+          {
+            low = f;
+          }
+        if (high < 0 || column[f] > column[high])
+          {
+            high = f;
+          }
+      }
+    reduced += present - keys.size();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Queue a batch for the next replot, dropping the oldest past the factor's queue length
+ * @param firstKey
+ * @param batch
+ */
+void OverloadGuard::defer (double firstKey, const SampleBatch &batch)
+{
+    const int limit = qMax (1, OVERLOAD_QUEUE / reduction);
+    while (deferredCount >= limit)
+      {
+        const SampleBatch &oldest = deferred[deferredFirst].batch;
+        for (int c = 0; c < oldest.channels.size(); c++)
+          {
+            if (oldest.hasChannel (c))
+              {
+                skipped += oldest.frames;
+              }
+          }
+        deferredFirst = (deferredFirst + 1) % OVERLOAD_QUEUE;
+        deferredCount--;
+      }
+
+    Deferred &entry = deferred[(deferredFirst + deferredCount) % OVERLOAD_QUEUE];
+    entry.firstKey = firstKey;
+    copyBatch (batch, entry.batch);                                                       // The caller reuses its batch
+    deferredCount++;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Oldest deferred batch still queued
+ * @param firstKey
+ * @param batch
+ * @return false when none is left
+ */
+bool OverloadGuard::takeDeferred (double &firstKey, SampleBatch &batch)
+{
+    if (deferredCount == 0)
+      {
+        return false;
+      }
+    firstKey = deferred[deferredFirst].firstKey;
+    copyBatch (deferred[deferredFirst].batch, batch);
+    deferredFirst = (deferredFirst + 1) % OVERLOAD_QUEUE;
+    deferredCount--;
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Forget deferred batches and counters, the data they refer to is gone
+ */
+void OverloadGuard::clear()
+{
+    deferredFirst = 0;
+    deferredCount = 0;
+    reduction = 1;
+    reduced = 0;
+    skipped = 0;
+    hiddenTexts = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief One line summary for the status bar
+ * @return
+ */
+QString OverloadGuard::toString() const
+{
+    return QString ("Overload: %1, display 1/%2, %3 samples decimated, %4 dropped, %5 UART chunks hidden")
+           .arg (policyNames().at (int (current)))
+           .arg (reduction)
+           .arg (reduced)
+           .arg (skipped)
+           .arg (hiddenTexts);
+}
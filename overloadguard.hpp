@@ -0,0 +1,110 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef OVERLOADGUARD_HPP
+#define OVERLOADGUARD_HPP
+
+#include <QVector>
+#include <QList>
+#include <QString>
+#include <QElapsedTimer>
+#include "samplebatch.hpp"
+
+#define OVERLOAD_PERIOD_MS   500                                                          // Load is measured over this period
+#define OVERLOAD_HIGH        0.6                                                          // Busy share that doubles the reduction
+#define OVERLOAD_LOW         0.25                                                         // Busy share that halves it again
+#define OVERLOAD_MAX_FACTOR  1024
+#define OVERLOAD_QUEUE       16                                                           // Deferred batches kept at factor 1
+
+/**
+ * @brief What the display path does with samples it cannot keep up with
+ */
+enum OverloadPolicy
+{
+    OverloadOff,                                                                          // Show everything, the event loop backs up
+    OverloadDecimate,                                                                     // Show every n-th sample
+    OverloadDropOldest,                                                                   // Show the newest batches, skip older ones
+    OverloadMinMax                                                                        // Show the min and max of every 2n samples
+};
+
+/**
+ * @brief Keeps the display real-time when data comes faster than it can be shown
+ *
+ * The GUI thread's ingest and replot work is timed with begin()/end().
+ * When it is busy more than OVERLOAD_HIGH of the time the reduction factor
+ * doubles, below OVERLOAD_LOW it halves, so the display work follows the
+ * input rate. Only the display consumers (auto Y, persistence, waterfall,
+ * UART window) are reduced: the store and the recording still get every
+ * sample. Skipped samples are counted.
+ */
+class OverloadGuard
+{
+public:
+    OverloadGuard();
+
+    void setPolicy (OverloadPolicy newPolicy);
+    OverloadPolicy policy() const { return current; }
+    static QStringList policyNames();                                                     // In OverloadPolicy order
+
+    void begin();                                                                         // Display work starts...
+    bool end();                                                                           // ...and ends; true when the factor changed
+    int factor() const { return reduction; }
+    bool overloaded() const { return current != OverloadOff && reduction > 1; }
+
+    /* Non NaN samples of one column, reduced by the policy while overloaded */
+    void select (const QVector<double> &column, int frames, double firstKey, QVector<double> &keys, QVector<double> &values);
+
+    void defer (double firstKey, const SampleBatch &batch);                               // Drop oldest: show at the next replot
+    bool takeDeferred (double &firstKey, SampleBatch &batch);
+    void hideText() { hiddenTexts++; }                                                    // UART window chunk not shown
+    void clear();
+
+    qint64 decimated() const { return reduced; }
+    qint64 dropped() const { return skipped; }
+    QString toString() const;
+
+private:
+    struct Deferred
+    {
+        double firstKey;
+        SampleBatch batch;
+    };
+
+    OverloadPolicy current;
+    int reduction;
+    QElapsedTimer clock;
+    qint64 periodStart;
+    qint64 busy;                                                                          // ns of display work in this period
+    qint64 workStart;
+    QVector<Deferred> deferred;                                                           // Ring of OVERLOAD_QUEUE slots, each keeps its columns
+    int deferredFirst;                                                                    // Oldest queued slot...
+    int deferredCount;                                                                    // ...and how many are queued
+    qint64 reduced;
+    qint64 skipped;
+    qint64 hiddenTexts;
+};
+
+#endif // OVERLOADGUARD_HPP
@@ -0,0 +1,333 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "persistence.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PERSISTENCE_SSE2
+#endif
+
+/**
+ * @brief Multiply every cell by the decay factor
+ * @param hits
+ * @param count
+ * @param factor
+ */
+static void decayHits (float *hits, int count, float factor)
+{
+    int i = 0;
+#ifdef PERSISTENCE_SSE2
+    const __m128 f = _mm_set1_ps (factor);
+    for (; i + 4 <= count; i += 4)
+      {
+        _mm_storeu_ps (hits + i, _mm_mul_ps (_mm_loadu_ps (hits + i), f));
+      }
+#endif
+    for (; i < count; i++)
+      {
+        hits[i] *= factor;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Grid column and row of a batch of samples
+ *
+ * Keys are folded onto the sweep, values mapped onto the rows (row 0 is the
+ * top). Results are truncated, not clamped; out of grid (and NaN) samples are
+ * rejected by the caller. Rows are the exception: negative ones would
+ * truncate onto row 0, so they (and NaN) come out as -1.
+ */
+static void hitIndices (const double *keys, const double *values, int count,
+                        double sweep, double columnScale, double top, double rowScale,
+                        int *columns, int *rows)
+{
+    int i = 0;
+#ifdef PERSISTENCE_SSE2
+    const __m128d vSweep = _mm_set1_pd (sweep);
+    const __m128d vColumnScale = _mm_set1_pd (columnScale);
+    const __m128d vTop = _mm_set1_pd (top);
+    const __m128d vRowScale = _mm_set1_pd (rowScale);
+    const __m128d vHalf = _mm_set1_pd (0.5);
+    const __m128d vZero = _mm_setzero_pd();
+    const __m128d vRowLimit = _mm_set1_pd (2147483647.0);
+    const __m128i vNoRow = _mm_set1_epi32 (-1);
+    for (; i + 2 <= count; i += 2)
+      {
+        const __m128d k = _mm_loadu_pd (keys + i);
+        const __m128d turns = _mm_cvtepi32_pd (_mm_cvttpd_epi32 (_mm_div_pd (k, vSweep)));
+        const __m128d folded = _mm_sub_pd (k, _mm_mul_pd (turns, vSweep));
+        const __m128d v = _mm_loadu_pd (values + i);
+        const __m128d r = _mm_add_pd (_mm_mul_pd (_mm_sub_pd (vTop, v), vRowScale), vHalf);
+        _mm_storel_epi64 (reinterpret_cast<__m128i*> (columns + i), _mm_cvttpd_epi32 (_mm_mul_pd (folded, vColumnScale)));
+        /* Same test as the scalar tail, the two lane masks moved down to the converted ints */
+        const __m128d inside = _mm_and_pd (_mm_cmpge_pd (r, vZero), _mm_cmplt_pd (r, vRowLimit));
+        const __m128i keep = _mm_shuffle_epi32 (_mm_castpd_si128 (inside), _MM_SHUFFLE (3, 3, 2, 0));
+        _mm_storel_epi64 (reinterpret_cast<__m128i*> (rows + i), _mm_or_si128 (_mm_cvttpd_epi32 (r), _mm_andnot_si128 (keep, vNoRow)));
+      }
+#endif
+    for (; i < count; i++)
+      {
+        const double folded = keys[i] - double (int (keys[i] / sweep)) * sweep;
+        const double r = (top - values[i]) * rowScale + 0.5;
+        columns[i] = int (folded * columnScale);
+        rows[i] = (r >= 0 && r < 2147483647.0) ? int (r) : -1;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Turn hit counts into premultiplied pixels of one color
+ * @param hits
+ * @param pixels
+ * @param count
+ * @param color
+ */
+static void colorizeHits (const float *hits, QRgb *pixels, int count, const QColor &color)
+{
+    const float red = color.red();
+    const float green = color.green();
+    const float blue = color.blue();
+
+    for (int i = 0; i < count; i++)
+      {
+        const float a = hits[i] / (hits[i] + PERSISTENCE_KNEE);
+        pixels[i] = qRgba (int (red * a), int (green * a), int (blue * a), int (255.0f * a));
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ * @param keyAxis
+ * @param valueAxis
+ */
+PersistenceMap::PersistenceMap (QCPAxis *keyAxis, QCPAxis *valueAxis) :
+  QCPAbstractPlottable (keyAxis, valueAxis),
+  mWidth (0),
+  mHeight (0),
+  mSweep (1000),
+  mDecay (PERSISTENCE_DECAY),
+  mColor (Qt::white),
+  mLastColumn (-1),
+  mLastRow (0)
+{
+    setSelectable (QCP::stNone);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Trace color; intensity is taken from the hit density
+ * @param color
+ */
+void PersistenceMap::setColor (const QColor &color)
+{
+    mColor = color;
+    setPen (QPen (color));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Length in keys of one sweep; a change restarts the accumulation
+ * @param keys
+ */
+void PersistenceMap::setSweep (double keys)
+{
+    if (keys > 0 && keys != mSweep)
+      {
+        mSweep = keys;
+        clear();
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Queue one sample; accumulated on the next draw
+ *
+ * A map that is not drawn keeps at most two sweeps queued; the oldest sweep
+ * is dropped in one go so queuing stays cheap.
+ * @param key
+ * @param value
+ */
+void PersistenceMap::addData (double key, double value)
+{
+    const int sweep = qMax (int (mSweep), 1);
+    if (mPendingKeys.size() >= 2 * sweep)
+      {
+        mPendingKeys.remove (0, sweep);
+        mPendingValues.remove (0, sweep);
+        mLastColumn = -1;
+      }
+    mPendingKeys.append (key);
+    mPendingValues.append (value);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Forget accumulated and queued samples
+ */
+void PersistenceMap::clear()
+{
+    mHits.fill (0.0f);
+    mPendingKeys.clear();
+    mPendingValues.clear();
+    mLastColumn = -1;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Add queued samples to the grid
+ *
+ * Consecutive samples in the same or adjacent columns are joined with a
+ * vertical span so the density looks like a trace instead of dots.
+ */
+void PersistenceMap::accumulate()
+{
+    const int count = mPendingKeys.size();
+    if (count == 0)
+      {
+        return;
+      }
+
+    mColumns.resize (count);
+    mRows.resize (count);
+    hitIndices (mPendingKeys.constData(), mPendingValues.constData(), count,
+                mSweep, mWidth / mSweep, mValueRange.upper, (mHeight - 1) / mValueRange.size(),
+                mColumns.data(), mRows.data());
+
+    float *hits = mHits.data();
+    for (int i = 0; i < count; i++)
+      {
+        const int column = mColumns[i];
+        const int row = mRows[i];
+        if (column < 0 || column >= mWidth || row < 0 || row >= mHeight)
+          {
+            mLastColumn = -1;
+            continue;
+          }
+
+        if (mLastColumn >= 0 && (column == mLastColumn || column == mLastColumn + 1))
+          {
+            const int to = qMax (row, mLastRow);
+            for (int r = qMin (row, mLastRow); r <= to; r++)
+              {
+                hits[r * mWidth + column] += 1.0f;
+              }
+          }
+        else
+          {
+            hits[row * mWidth + column] += 1.0f;
+          }
+        mLastColumn = column;
+        mLastRow = row;
+      }
+
+    mPendingKeys.clear();
+    mPendingValues.clear();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Decay, accumulate and blit the density image over the axis rect
+ * @param painter
+ */
+void PersistenceMap::draw (QCPPainter *painter)
+{
+    if (!mKeyAxis || !mValueAxis)
+      {
+        return;
+      }
+
+    const QRect rect = clipRect();
+    const QCPRange valueRange = mValueAxis.data()->range();
+    if (rect.width() != mWidth || rect.height() != mHeight || valueRange != mValueRange)
+      {
+        mWidth = rect.width();
+        mHeight = rect.height();
+        mValueRange = valueRange;
+        mHits.fill (0.0f, qMax (mWidth * mHeight, 0));
+        mImage = QImage (qMax (mWidth, 1), qMax (mHeight, 1), QImage::Format_ARGB32_Premultiplied);
+        mLastColumn = -1;
+      }
+    if (mWidth <= 1 || mHeight <= 1 || mValueRange.size() <= 0)
+      {
+        return;
+      }
+
+    decayHits (mHits.data(), mHits.size(), mDecay);
+    accumulate();
+    colorizeHits (mHits.constData(), reinterpret_cast<QRgb*> (mImage.bits()), mHits.size(), mColor);
+
+    painter->drawImage (rect.topLeft(), mImage);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Legend icon: a line in the channel color
+ * @param painter
+ * @param rect
+ */
+void PersistenceMap::drawLegendIcon (QCPPainter *painter, const QRectF &rect) const
+{
+    painter->setPen (QPen (mColor));
+    painter->drawLine (QLineF (rect.left(), rect.center().y(), rect.right(), rect.center().y()));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Not selectable
+ */
+double PersistenceMap::selectTest (const QPointF &pos, bool onlySelectable, QVariant *details) const
+{
+    Q_UNUSED (pos)
+    Q_UNUSED (onlySelectable)
+    Q_UNUSED (details)
+    return -1;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief The map follows the axes, so it never contributes to rescaling
+ */
+QCPRange PersistenceMap::getKeyRange (bool &foundRange, QCP::SignDomain inSignDomain) const
+{
+    Q_UNUSED (inSignDomain)
+    foundRange = false;
+    return QCPRange();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief The map follows the axes, so it never contributes to rescaling
+ */
+QCPRange PersistenceMap::getValueRange (bool &foundRange, QCP::SignDomain inSignDomain, const QCPRange &inKeyRange) const
+{
+    Q_UNUSED (inSignDomain)
+    Q_UNUSED (inKeyRange)
+    foundRange = false;
+    return QCPRange();
+}
@@ -0,0 +1,84 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef PERSISTENCE_HPP
+#define PERSISTENCE_HPP
+
+#include "qcustomplot/qcustomplot.h"
+
+#define PERSISTENCE_DECAY    0.92f                                                        // Hit count kept per replot
+#define PERSISTENCE_KNEE     2.0f                                                         // Hits for half intensity
+
+/**
+ * @brief Phosphor-like density display of one channel
+ *
+ * Samples are folded onto a sweep of setSweep() keys and accumulated into a
+ * hit-count grid with one cell per axis rect pixel. Every draw decays the
+ * whole grid and colorizes it with the channel color, so rendering cost
+ * only depends on the plot size, not on how many samples were received.
+ * The grid is reset whenever the axis rect size or value range changes.
+ */
+class PersistenceMap : public QCPAbstractPlottable
+{
+    Q_OBJECT
+
+public:
+    PersistenceMap (QCPAxis *keyAxis, QCPAxis *valueAxis);
+
+    void setColor (const QColor &color);
+    void setDecay (float factor) { mDecay = factor; }
+    void setSweep (double keys);                                                          // Keys folded onto the key axis
+    void addData (double key, double value);                                              // Queued until the next draw
+    void clear();
+
+    virtual double selectTest (const QPointF &pos, bool onlySelectable, QVariant *details = 0) const Q_DECL_OVERRIDE;
+    virtual QCPRange getKeyRange (bool &foundRange, QCP::SignDomain inSignDomain = QCP::sdBoth) const Q_DECL_OVERRIDE;
+    virtual QCPRange getValueRange (bool &foundRange, QCP::SignDomain inSignDomain = QCP::sdBoth, const QCPRange &inKeyRange = QCPRange()) const Q_DECL_OVERRIDE;
+
+protected:
+    virtual void draw (QCPPainter *painter) Q_DECL_OVERRIDE;
+    virtual void drawLegendIcon (QCPPainter *painter, const QRectF &rect) const Q_DECL_OVERRIDE;
+
+private:
+    int mWidth, mHeight;
+    QCPRange mValueRange;                                                                 // Value range the grid was built for
+    double mSweep;
+    float mDecay;
+    QColor mColor;
+
+    QVector<float> mHits;                                                                 // mHeight rows of mWidth cells, top row first
+    QVector<double> mPendingKeys;
+    QVector<double> mPendingValues;
+    QVector<int> mColumns;                                                                // Scratch for the accumulation kernel
+    QVector<int> mRows;
+    int mLastColumn;
+    int mLastRow;
+    QImage mImage;
+
+    void accumulate();
+};
+
+#endif // PERSISTENCE_HPP
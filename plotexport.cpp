@@ -0,0 +1,108 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "plotexport.hpp"
+#include <QImage>
+#include <QtConcurrent>
+
+/**
+ * @brief Constructor
+ * @param parent
+ */
+PlotExport::PlotExport (QObject *parent) :
+  QObject (parent),
+  busy (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Snapshot the plot now, write the PNG in the background
+ *
+ * Same arguments as QCustomPlot::savePng().
+ * @param plot
+ * @param fileName
+ * @param width Logical size of the plot in the image
+ * @param height
+ * @param scale Pixels per logical unit
+ * @param quality PNG compression setting, -1 for the default
+ */
+void PlotExport::savePng (QCustomPlot *plot, const QString &fileName, int width, int height, double scale, int quality)
+{
+    Job job;
+    job.fileName = fileName;
+    job.width = width;
+    job.height = height;
+    job.scale = scale;
+    job.quality = quality;
+
+    QCPPainter painter (&job.picture);
+    if (scale > 1.0)
+      {
+        painter.setMode (QCPPainter::pmNonCosmetic);                                     // Lines scale with the image, as in savePng()
+      }
+    plot->toPainter (&painter, width, height);
+    painter.end();
+
+    busy++;
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool> (this);
+    watcher->setProperty ("fileName", fileName);
+    connect (watcher, SIGNAL (finished()), this, SLOT (onFinished()));
+    watcher->setFuture (QtConcurrent::run (render, job));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Replay the recorded plot into an image and encode it, on a pool thread
+ * @param job
+ * @return false if the file could not be written
+ */
+bool PlotExport::render (const Job &job)
+{
+    QImage image (qRound (job.width * job.scale), qRound (job.height * job.scale), QImage::Format_ARGB32_Premultiplied);
+    image.fill (Qt::transparent);
+    image.setDotsPerMeterX (qRound (job.picture.logicalDpiX() / 0.0254));                 // Text keeps the size it was recorded with
+    image.setDotsPerMeterY (qRound (job.picture.logicalDpiY() / 0.0254));
+
+    QPainter painter (&image);
+    painter.scale (job.scale, job.scale);
+    painter.drawPicture (0, 0, job.picture);
+    painter.end();
+
+    return image.save (job.fileName, "PNG", job.quality);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief An export is done
+ */
+void PlotExport::onFinished()
+{
+    QFutureWatcher<bool> *watcher = static_cast<QFutureWatcher<bool>*> (sender());
+    busy--;
+    emit saved (watcher->property ("fileName").toString(), watcher->result());
+    watcher->deleteLater();
+}
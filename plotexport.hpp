@@ -0,0 +1,76 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef PLOTEXPORT_HPP
+#define PLOTEXPORT_HPP
+
+#include <QObject>
+#include <QPicture>
+#include <QFutureWatcher>
+#include "qcustomplot/qcustomplot.h"
+
+/**
+ * @brief Saves plot images without stalling the GUI thread
+ *
+ * The GUI thread only records the plot's paint commands into a QPicture,
+ * which is cheap since traces are already reduced to pixel columns. The
+ * rasterization at full size and the PNG encoding happen on the thread
+ * pool; saved() reports back when the file is written. Several exports may
+ * be in flight at once.
+ */
+class PlotExport : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PlotExport (QObject *parent = nullptr);
+
+    int pending() const { return busy; }
+    void savePng (QCustomPlot *plot, const QString &fileName, int width, int height, double scale, int quality = -1);
+
+signals:
+    void saved (const QString &fileName, bool ok);
+
+private slots:
+    void onFinished();
+
+private:
+    struct Job
+    {
+        QPicture picture;                                                                 // Plot at width x height
+        QString fileName;
+        int width;
+        int height;
+        double scale;
+        int quality;
+    };
+
+    int busy;
+
+    static bool render (const Job &job);
+};
+
+#endif // PLOTEXPORT_HPP
@@ -0,0 +1,61 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef SAMPLEBATCH_HPP
+#define SAMPLEBATCH_HPP
+
+#include <QVector>
+
+/**
+ * @brief Frames received in one read, stored column by column
+ *
+ * A column is either empty (channel not present in this batch) or holds
+ * exactly 'frames' values, NaN for frames where the channel had no value.
+ * clear() keeps the allocated columns so a batch can be reused.
+ */
+struct SampleBatch
+{
+    int frames;
+    QVector<QVector<double> > channels;
+
+    SampleBatch() : frames (0) {}
+
+    void clear()
+    {
+        frames = 0;
+        for (int i = 0; i < channels.size(); i++)
+          {
+            channels[i].resize (0);
+          }
+    }
+
+    bool hasChannel (int channel) const
+    {
+        return channel < channels.size() && channels[channel].size() == frames && frames > 0;
+    }
+};
+
+#endif // SAMPLEBATCH_HPP
@@ -0,0 +1,526 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "serialreader.hpp"
+#include <QElapsedTimer>
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <cstring>
+#include <cerrno>
+#endif
+
+/**
+ * @brief Default: normal scheduling, any core, nothing locked
+ */
+ReaderOptions::ReaderOptions() :
+  policy (ReaderNormal),
+  priority (0),
+  cpu (-1),
+  lockMemory (false),
+  lowLatency (false),
+  readBufferSize (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Parse space separated options
+ *
+ * "thread" (just a reader thread), "fifo[:priority]", "rr[:priority]",
+ * "cpu:n", "mlock", "lowlatency" and "buffer:bytes" (k and M suffixes).
+ * @param spec
+ * @param options Filled on success
+ * @param error Filled on failure
+ * @return
+ */
+bool ReaderOptions::parse (const QString &spec, ReaderOptions &options, QString *error)
+{
+    ReaderOptions parsed;
+    foreach (const QString &token, spec.split (' ', QString::SkipEmptyParts))
+      {
+        const QString name = token.section (':', 0, 0).toLower();
+        const QString value = token.section (':', 1);
+        bool ok = true;
+        if (name == "thread")
+          {
+          }
+        else if (name == "fifo" || name == "rr")
+          {
+            parsed.policy = name == "fifo" ? ReaderFifo : ReaderRoundRobin;
+            parsed.priority = value.isEmpty() ? 50 : value.toInt (&ok);
+            ok = ok && parsed.priority >= 1 && parsed.priority <= 99;
+          }
+        else if (name == "cpu")
+          {
+            parsed.cpu = value.toInt (&ok);
+            ok = ok && parsed.cpu >= 0;
+          }
+        else if (name == "mlock" && value.isEmpty())
+          {
+            parsed.lockMemory = true;
+          }
+        else if (name == "lowlatency" && value.isEmpty())
+          {
+            parsed.lowLatency = true;
+          }
+        else if (name == "buffer")
+          {
+            QString digits = value.toLower();
+            qint64 unit = 1;
+            if (digits.endsWith ('k'))
+              {
+                unit = 1024;
+              }
+            else if (digits.endsWith ('m'))
+              {
+                unit = 1024 * 1024;
+              }
+            if (unit > 1)
+              {
+                digits.chop (1);
+              }
+            parsed.readBufferSize = digits.toLongLong (&ok) * unit;
+            ok = ok && parsed.readBufferSize >= 0;
+          }
+        else
+          {
+            ok = false;
+          }
+        if (!ok)
+          {
+            if (error != nullptr)
+              {
+                *error = "Bad reader option: " + token;
+              }
+            return false;
+          }
+      }
+    options = parsed;
+    return true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Spec that parse() turns back into the same options
+ * @return
+ */
+QString ReaderOptions::toString() const
+{
+    QStringList tokens;
+    if (policy != ReaderNormal)
+      {
+        tokens << QString ("%1:%2").arg (policy == ReaderFifo ? "fifo" : "rr").arg (priority);
+      }
+    if (cpu >= 0)
+      {
+        tokens << QString ("cpu:%1").arg (cpu);
+      }
+    if (lockMemory)
+      {
+        tokens << "mlock";
+      }
+    if (lowLatency)
+      {
+        tokens << "lowlatency";
+      }
+    if (readBufferSize > 0)
+      {
+        tokens << QString ("buffer:%1").arg (readBufferSize);
+      }
+    return tokens.isEmpty() ? QString ("thread") : tokens.join (' ');
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief All counters zero, overruns unknown
+ */
+ReaderStatistics::ReaderStatistics() :
+  bytes (0),
+  reads (0),
+  overruns (-1),
+  bufferOverruns (-1),
+  maxGap (0),
+  maxLate (0),
+  maxPending (0),
+  postponed (0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief One line summary
+ * @return
+ */
+QString ReaderStatistics::toString() const
+{
+    QString text = QString ("overruns %1, buffer overruns %2, worst gap %3 ms, late wake up %4 ms, most pending %5 B, postponed %6")
+                   .arg (overruns < 0 ? QString ("n/a") : QString::number (overruns))
+                   .arg (bufferOverruns < 0 ? QString ("n/a") : QString::number (bufferOverruns))
+                   .arg (maxGap / 1000.0, 0, 'f', 2)
+                   .arg (maxLate / 1000.0, 0, 'f', 2)
+                   .arg (maxPending)
+                   .arg (postponed);
+    if (!warnings.isEmpty())
+      {
+        text += " (" + warnings.join ("; ") + ")";
+      }
+    return text;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ * @param pool Where the read buffers come from, must outlive the reader
+ * @param parent
+ */
+SerialReader::SerialReader (BufferPool *pool, QObject *parent) :
+    QThread (parent),
+    mPool (pool),
+    mBaudRate (0),
+    mDataBits (QSerialPort::Data8),
+    mParity (QSerialPort::NoParity),
+    mStopBits (QSerialPort::OneStop),
+    mStop (0),
+    mOpenState (0),
+    mOverrunBase (0),
+    mBufferOverrunBase (0)
+{
+    mQueue.reserve (pool->count());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Destructor, closes the port and gives queued buffers back
+ */
+SerialReader::~SerialReader()
+{
+    close();
+    ReadBuffer *buffer;
+    while ((buffer = take()) != nullptr)
+      {
+        mPool->release (buffer);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Start the thread and wait until it opened the port
+ * @param portName
+ * @param baudRate
+ * @param dataBits
+ * @param parity
+ * @param stopBits
+ * @return false if the port cannot be opened, see errorString()
+ */
+bool SerialReader::open (const QString &portName, int baudRate, QSerialPort::DataBits dataBits, QSerialPort::Parity parity, QSerialPort::StopBits stopBits)
+{
+    close();
+    mPortName = portName;
+    mBaudRate = baudRate;
+    mDataBits = dataBits;
+    mParity = parity;
+    mStopBits = stopBits;
+    mStop.storeRelease (0);
+    mStatistics = ReaderStatistics();
+
+    QMutexLocker locker (&mLock);
+    mOpenState = 0;
+    start();
+    while (mOpenState == 0)
+      {
+        mOpened.wait (&mLock);
+      }
+    return mOpenState > 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Stop reading and close the port
+ */
+void SerialReader::close()
+{
+    mStop.storeRelease (1);
+    wait();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Why open() failed or the port was lost
+ * @return
+ */
+QString SerialReader::errorString()
+{
+    QMutexLocker locker (&mLock);
+    return mError;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Oldest filled buffer, to be given back to the pool once used
+ * @return nullptr if none is queued
+ */
+ReadBuffer *SerialReader::take()
+{
+    QMutexLocker locker (&mLock);
+    if (mQueue.isEmpty())
+      {
+        return nullptr;
+      }
+    ReadBuffer *buffer = mQueue.first();
+    mQueue.removeFirst();
+    return buffer;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Copy of the counters
+ * @return
+ */
+ReaderStatistics SerialReader::statistics()
+{
+    QMutexLocker locker (&mLock);
+    return mStatistics;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Apply the scheduling, affinity, memory and driver options to the calling thread and port
+ * @param port
+ * @return What could not be applied
+ */
+QStringList SerialReader::applyOptions (QSerialPort &port)
+{
+    QStringList warnings;
+    if (mOptions.readBufferSize > 0)
+      {
+        port.setReadBufferSize (mOptions.readBufferSize);
+      }
+    if (mOptions.lockMemory && !mPool->lockMemory())
+      {
+        warnings << "mlock failed";
+      }
+
+#ifdef Q_OS_LINUX
+    if (mOptions.policy != ReaderNormal)
+      {
+        sched_param param;
+        param.sched_priority = mOptions.priority;
+        const int result = pthread_setschedparam (pthread_self(), mOptions.policy == ReaderFifo ? SCHED_FIFO : SCHED_RR, &param);
+        if (result != 0)
+          {
+            warnings << QString ("%1: %2").arg (mOptions.policy == ReaderFifo ? "SCHED_FIFO" : "SCHED_RR").arg (strerror (result));
+          }
+      }
+    if (mOptions.cpu >= 0)
+      {
+        cpu_set_t cpus;
+        CPU_ZERO (&cpus);
+        CPU_SET (mOptions.cpu, &cpus);
+        const int result = pthread_setaffinity_np (pthread_self(), sizeof (cpus), &cpus);
+        if (result != 0)
+          {
+            warnings << QString ("cpu %1: %2").arg (mOptions.cpu).arg (strerror (result));
+          }
+      }
+    if (mOptions.lowLatency)
+      {
+        serial_struct serial;
+        bool set = ioctl (port.handle(), TIOCGSERIAL, &serial) == 0;
+        if (set)
+          {
+            serial.flags |= ASYNC_LOW_LATENCY;
+            set = ioctl (port.handle(), TIOCSSERIAL, &serial) == 0;
+          }
+        if (!set)
+          {
+            warnings << QString ("lowlatency: %1").arg (strerror (errno));
+          }
+      }
+#else
+    if (mOptions.policy != ReaderNormal)
+      {
+        setPriority (QThread::TimeCriticalPriority);                                      // Closest to a real-time class here
+      }
+    if (mOptions.cpu >= 0)
+      {
+        warnings << "cpu pinning not supported here";
+      }
+    if (mOptions.lowLatency)
+      {
+        warnings << "lowlatency not supported here";
+      }
+#endif
+    return warnings;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Update the driver's overrun counters, relative to when the port was opened
+ * @param port
+ */
+void SerialReader::pollOverruns (QSerialPort &port)
+{
+#ifdef Q_OS_LINUX
+    serial_icounter_struct counters;
+    if (ioctl (port.handle(), TIOCGICOUNT, &counters) != 0)
+      {
+        return;                                                                           // Driver does not count, stays n/a
+      }
+    QMutexLocker locker (&mLock);
+    if (mStatistics.overruns < 0)
+      {
+        mOverrunBase = counters.overrun;
+        mBufferOverrunBase = counters.buf_overrun;
+      }
+    mStatistics.overruns = counters.overrun - mOverrunBase;
+    mStatistics.bufferOverruns = counters.buf_overrun - mBufferOverrunBase;
+#else
+    Q_UNUSED (port);
+#endif
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Open the port, then read it into pooled buffers until close()
+ *
+ * Scheduling delays are measured two ways: how late the thread wakes up
+ * after a wait that timed out, and the longest time between two reads
+ * while data kept arriving.
+ */
+void SerialReader::run()
+{
+    QSerialPort port (mPortName);
+    const bool opened = port.open (QIODevice::ReadOnly);
+    QStringList warnings;
+    if (opened)
+      {
+        port.setBaudRate (mBaudRate);
+        port.setDataBits (mDataBits);
+        port.setParity (mParity);
+        port.setStopBits (mStopBits);
+        warnings = applyOptions (port);
+      }
+
+    mLock.lock();
+    mError = port.errorString();
+    mStatistics.warnings = warnings;
+    mOpenState = opened ? 1 : -1;
+    mOpened.wakeAll();
+    mLock.unlock();
+    if (!opened)
+      {
+        return;
+      }
+    pollOverruns (port);
+
+    QElapsedTimer clock;
+    clock.start();
+    qint64 lastRead = -1;                                                                 // ns, -1 when the line went quiet
+    qint64 lastPoll = 0;
+    ReadBuffer *buffer = nullptr;
+    while (mStop.loadAcquire() == 0)
+      {
+        const qint64 waited = clock.nsecsElapsed();
+        const bool ready = port.bytesAvailable() > 0 || port.waitForReadyRead (READER_WAIT_MS);
+        const qint64 woke = clock.nsecsElapsed();
+
+        if (!ready && port.error() != QSerialPort::NoError && port.error() != QSerialPort::TimeoutError)
+          {
+            const QString error = port.errorString();
+            mLock.lock();
+            mError = error;
+            mLock.unlock();
+            emit failed (error);
+            break;
+          }
+        if (woke - lastPoll >= READER_WAIT_MS * 1000000LL)
+          {
+            pollOverruns (port);
+            lastPoll = woke;
+          }
+        if (!ready)
+          {
+            QMutexLocker locker (&mLock);
+            mStatistics.maxLate = qMax (mStatistics.maxLate, (woke - waited) / 1000 - READER_WAIT_MS * 1000LL);
+            lastRead = -1;
+            continue;
+          }
+
+        const qint64 pending = port.bytesAvailable();
+        bool queued = false;
+        bool wasEmpty = false;
+        while (port.bytesAvailable() > 0)
+          {
+            if (buffer == nullptr && (buffer = mPool->acquire()) == nullptr)
+              {
+                QMutexLocker locker (&mLock);
+                mStatistics.postponed++;
+                break;
+              }
+            buffer->size = int (port.read (buffer->bytes(), buffer->capacity()));
+            if (buffer->size <= 0)
+              {
+                break;
+              }
+            QMutexLocker locker (&mLock);
+            wasEmpty = wasEmpty || mQueue.isEmpty();
+            mQueue.append (buffer);                                                       // Within the reserved size
+            mStatistics.bytes += buffer->size;
+            mStatistics.reads++;
+            buffer = nullptr;
+            queued = true;
+          }
+
+        mLock.lock();
+        mStatistics.maxPending = qMax (mStatistics.maxPending, pending);
+        if (lastRead >= 0)
+          {
+            mStatistics.maxGap = qMax (mStatistics.maxGap, (woke - lastRead) / 1000);
+          }
+        mLock.unlock();
+        lastRead = woke;
+
+        if (wasEmpty)
+          {
+            emit dataReady();
+          }
+        if (!queued)
+          {
+            msleep (1);                                                                   // Consumer behind, let it give buffers back
+          }
+      }
+
+    if (buffer != nullptr)
+      {
+        mPool->release (buffer);
+      }
+    pollOverruns (port);
+    port.close();
+}
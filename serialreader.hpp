@@ -0,0 +1,146 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef SERIALREADER_HPP
+#define SERIALREADER_HPP
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QVector>
+#include <QStringList>
+#include <QtSerialPort/QSerialPort>
+#include "bufferpool.hpp"
+
+#define READER_WAIT_MS       50                                                           // Longest wait for data, also the overrun poll period
+
+/**
+ * @brief Scheduling class of the reader thread
+ */
+enum ReaderPolicy
+{
+    ReaderNormal,
+    ReaderFifo,                                                                           // SCHED_FIFO
+    ReaderRoundRobin                                                                      // SCHED_RR
+};
+
+/**
+ * @brief How the reader thread runs, given as a spec such as "fifo:80 cpu:2 mlock buffer:65536"
+ */
+struct ReaderOptions
+{
+    ReaderPolicy policy;
+    int priority;                                                                         // 1..99 for fifo and rr
+    int cpu;                                                                              // Core to pin to, -1 for any
+    bool lockMemory;                                                                      // mlock() the read buffers
+    bool lowLatency;                                                                      // Driver low latency flag (Linux)
+    qint64 readBufferSize;                                                                // QSerialPort::setReadBufferSize(), 0 unlimited
+
+    ReaderOptions();
+
+    static bool parse (const QString &spec, ReaderOptions &options, QString *error);
+    QString toString() const;
+};
+
+/**
+ * @brief What the reader thread saw, to verify the options do their job
+ */
+struct ReaderStatistics
+{
+    qint64 bytes;
+    qint64 reads;
+    qint64 overruns;                                                                      // UART FIFO overruns counted by the driver, -1 if unknown
+    qint64 bufferOverruns;                                                                // tty buffer overruns, -1 if unknown
+    qint64 maxGap;                                                                        // Longest time between reads while data kept coming, us
+    qint64 maxLate;                                                                       // Longest wake up after a timed out wait, us
+    qint64 maxPending;                                                                    // Most bytes found waiting at one read
+    qint64 postponed;                                                                     // Reads put off because no buffer was free
+    QStringList warnings;                                                                 // Options that could not be applied
+
+    ReaderStatistics();
+
+    QString toString() const;
+};
+
+/**
+ * @brief Reads a serial port on its own thread into pooled buffers
+ *
+ * The port is opened, read and closed by the thread, which can run with a
+ * real-time policy, pinned to a core and with its buffers locked in RAM.
+ * Filled buffers are queued for the consumer, dataReady() is only emitted
+ * when the queue was empty so a busy consumer is not flooded with events;
+ * take() them until it returns nullptr and give each back to the pool.
+ * When no buffer is free the bytes stay in the port's buffers.
+ */
+class SerialReader : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit SerialReader (BufferPool *pool, QObject *parent = nullptr);
+    ~SerialReader();
+
+    void setOptions (const ReaderOptions &options) { mOptions = options; }                // Before open()
+    bool open (const QString &portName, int baudRate, QSerialPort::DataBits dataBits, QSerialPort::Parity parity, QSerialPort::StopBits stopBits);
+    void close();                                                                         // Stops the thread, queued buffers stay to take()
+    QString portName() const { return mPortName; }
+    QString errorString();
+
+    ReadBuffer *take();
+    ReaderStatistics statistics();
+
+signals:
+    void dataReady();
+    void failed (const QString &error);                                                   // Port lost, the thread has ended
+
+protected:
+    virtual void run() Q_DECL_OVERRIDE;
+
+private:
+    BufferPool *mPool;
+    ReaderOptions mOptions;
+    QString mPortName;
+    int mBaudRate;
+    QSerialPort::DataBits mDataBits;
+    QSerialPort::Parity mParity;
+    QSerialPort::StopBits mStopBits;
+    QString mError;
+    QAtomicInt mStop;
+
+    QMutex mLock;                                                                         // Guards everything below
+    QWaitCondition mOpened;
+    int mOpenState;                                                                       // 0 opening, 1 open, -1 failed
+    QVector<ReadBuffer*> mQueue;
+    ReaderStatistics mStatistics;
+    qint64 mOverrunBase;                                                                  // Driver counters when the port was opened
+    qint64 mBufferOverrunBase;
+
+    QStringList applyOptions (QSerialPort &port);
+    void pollOverruns (QSerialPort &port);
+};
+
+#endif // SERIALREADER_HPP
@@ -0,0 +1,111 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "slidingminmax.hpp"
+#include <QtNumeric>
+
+/**
+ * @brief Append at the back, doubling the ring when full
+ * @param entry
+ */
+void SlidingMinMax::Queue::pushBack (const Entry &entry)
+{
+    if (count == ring.size())
+      {
+        QVector<Entry> grown (ring.size() * 2);
+        for (int i = 0; i < count; i++)
+          {
+            grown[i] = ring[(head + i) & (ring.size() - 1)];
+          }
+        ring = grown;
+        head = 0;
+      }
+    ring[(head + count) & (ring.size() - 1)] = entry;
+    count++;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ */
+SlidingMinMax::SlidingMinMax()
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Forget all samples
+ */
+void SlidingMinMax::clear()
+{
+    minQueue.head = minQueue.count = 0;
+    maxQueue.head = maxQueue.count = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Add the newest sample, dropping the ones it dominates
+ * @param key
+ * @param value
+ */
+void SlidingMinMax::append (double key, double value)
+{
+    if (qIsNaN (value))
+      {
+        return;
+      }
+
+    const Entry entry = { key, value };
+
+    while (maxQueue.count > 0 && maxQueue.back().value <= value)
+      {
+        maxQueue.popBack();
+      }
+    maxQueue.pushBack (entry);
+
+    while (minQueue.count > 0 && minQueue.back().value >= value)
+      {
+        minQueue.popBack();
+      }
+    minQueue.pushBack (entry);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Drop samples with a key lower than 'key'
+ * @param key New window start
+ */
+void SlidingMinMax::removeBefore (double key)
+{
+    while (maxQueue.count > 0 && maxQueue.front().key < key)
+      {
+        maxQueue.popFront();
+      }
+    while (minQueue.count > 0 && minQueue.front().key < key)
+      {
+        minQueue.popFront();
+      }
+}
@@ -0,0 +1,79 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef SLIDINGMINMAX_HPP
+#define SLIDINGMINMAX_HPP
+
+#include <QVector>
+
+/**
+ * @brief Minimum and maximum of the samples in a sliding key window
+ *
+ * Two monotonic queues: the max queue only keeps samples that are larger
+ * than every later sample, the min queue the smaller ones. Appending pops
+ * dominated samples from the back, sliding the window pops expired samples
+ * from the front, so both are O(1) amortized and the extremes are always
+ * at the front. Keys must be appended in increasing order.
+ */
+class SlidingMinMax
+{
+public:
+    SlidingMinMax();
+
+    void clear();
+    void append (double key, double value);                                               // NaN values are ignored
+    void removeBefore (double key);                                                       // Slide the window start
+    bool isEmpty() const { return maxQueue.count == 0; }
+    double minimum() const { return minQueue.front().value; }
+    double maximum() const { return maxQueue.front().value; }
+
+private:
+    struct Entry
+    {
+        double key;
+        double value;
+    };
+
+    /* Ring buffer deque, capacity is a power of two */
+    struct Queue
+    {
+        QVector<Entry> ring;
+        int head;
+        int count;
+
+        Queue() : ring (16), head (0), count (0) {}
+        const Entry &front() const { return ring[head]; }
+        const Entry &back() const { return ring[(head + count - 1) & (ring.size() - 1)]; }
+        void popFront() { head = (head + 1) & (ring.size() - 1); count--; }
+        void popBack() { count--; }
+        void pushBack (const Entry &entry);
+    };
+
+    Queue minQueue;
+    Queue maxQueue;
+};
+
+#endif // SLIDINGMINMAX_HPP
@@ -0,0 +1,135 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "spectrum.hpp"
+#include <QtMath>
+
+/**
+ * @brief Constructor
+ * @param size FFT length, rounded up to a power of two
+ */
+Spectrum::Spectrum (int size) :
+  n (0),
+  log2n (0)
+{
+    setSize (size);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Rebuild window, twiddle and bit reversal tables for a new length
+ * @param size
+ */
+void Spectrum::setSize (int size)
+{
+    int bits = 1;
+    while ((1 << bits) < size && bits < 20)
+      {
+        bits++;
+      }
+    if ((1 << bits) == n)
+      {
+        return;
+      }
+
+    log2n = bits;
+    n = 1 << bits;
+
+    window.resize (n);
+    reversed.resize (n);
+    re.resize (n);
+    im.resize (n);
+    cosTable.resize (n / 2);
+    sinTable.resize (n / 2);
+
+    for (int i = 0; i < n; i++)
+      {
+        window[i] = 0.5 - 0.5 * qCos (2.0 * M_PI * i / (n - 1));
+
+        int r = 0;
+        for (int b = 0; b < log2n; b++)
+          {
+            r |= ((i >> b) & 1) << (log2n - 1 - b);
+          }
+        reversed[i] = r;
+      }
+
+    for (int i = 0; i < n / 2; i++)
+      {
+        cosTable[i] = qCos (2.0 * M_PI * i / n);
+        sinTable[i] = -qSin (2.0 * M_PI * i / n);
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Window, transform and convert one frame to amplitudes in dB
+ * @param samples size() input samples, oldest first
+ * @param out bins() output values
+ */
+void Spectrum::magnitudes (const double *samples, double *out)
+{
+    double *pr = re.data();
+    double *pi = im.data();
+    double windowSum = 0;
+
+    /* Windowed input, already in bit reversed order */
+    for (int i = 0; i < n; i++)
+      {
+        pr[reversed[i]] = samples[i] * window[i];
+        pi[i] = 0;
+        windowSum += window[i];
+      }
+
+    /* Iterative radix-2 butterflies */
+    for (int half = 1, stride = n / 2; half < n; half <<= 1, stride >>= 1)
+      {
+        for (int start = 0; start < n; start += half << 1)
+          {
+            for (int k = 0; k < half; k++)
+              {
+                const double wr = cosTable[k * stride];
+                const double wi = sinTable[k * stride];
+                const int a = start + k;
+                const int b = a + half;
+                const double tr = pr[b] * wr - pi[b] * wi;
+                const double ti = pr[b] * wi + pi[b] * wr;
+                pr[b] = pr[a] - tr;
+                pi[b] = pi[a] - ti;
+                pr[a] += tr;
+                pi[a] += ti;
+              }
+          }
+      }
+
+    /* Single sided amplitude, corrected for the window gain */
+    const double scale = 2.0 / windowSum;
+    for (int i = 0; i < n / 2 + 1; i++)
+      {
+        const double amplitude = qSqrt (pr[i] * pr[i] + pi[i] * pi[i]) * scale;
+        out[i] = 20.0 * std::log10 (amplitude + 1e-12);
+      }
+}
@@ -0,0 +1,61 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef SPECTRUM_HPP
+#define SPECTRUM_HPP
+
+#include <QVector>
+
+/**
+ * @brief Magnitude spectrum of a real signal
+ *
+ * Radix-2 FFT with a Hann window. Twiddles, window and bit reversal table
+ * are computed once per size, so transforming a frame does not allocate.
+ */
+class Spectrum
+{
+public:
+    explicit Spectrum (int size = 512);
+
+    void setSize (int size);                                                              // Rounded up to a power of two
+    int size() const { return n; }
+    int bins() const { return n / 2 + 1; }                                                // DC .. Nyquist
+
+    /* Transform 'size()' samples, write 'bins()' amplitudes in dB to 'out' */
+    void magnitudes (const double *samples, double *out);
+
+private:
+    int n;
+    int log2n;
+    QVector<double> window;
+    QVector<double> cosTable;
+    QVector<double> sinTable;
+    QVector<int>    reversed;
+    QVector<double> re;
+    QVector<double> im;
+};
+
+#endif // SPECTRUM_HPP
@@ -0,0 +1,130 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "tracecompositor.hpp"
+#include <QtConcurrent>
+
+/**
+ * @brief Constructor, the compositor goes to the plot's current layer
+ * @param plot
+ */
+TraceCompositor::TraceCompositor (QCustomPlot *plot) :
+    QCPLayerable (plot, "main"),
+    mEnabled (false)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Switch between parallel tiles and each view drawing itself
+ * @param enabled
+ */
+void TraceCompositor::setEnabled (bool enabled)
+{
+    mEnabled = enabled;
+    for (int i = 0; i < mParentPlot->plottableCount(); i++)
+      {
+        ChannelView *view = qobject_cast<ChannelView*> (mParentPlot->plottable (i));
+        if (view != nullptr)
+          {
+            view->setDeferred (enabled);
+          }
+      }
+    if (!enabled)
+      {
+        mTiles.clear();
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Tiles are blitted, no antialiasing involved
+ * @param painter
+ */
+void TraceCompositor::applyDefaultAntialiasingHint (QCPPainter *painter) const
+{
+    applyAntialiasingHint (painter, false, QCP::aePlottables);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Tiles are clipped to the axis rect, like the views
+ * @return
+ */
+QRect TraceCompositor::clipRect() const
+{
+    return mParentPlot->axisRect()->rect();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Render one channel's tile, on a pool thread
+ * @param tile
+ */
+void TraceCompositor::render (Tile &tile)
+{
+    tile.target = tile.view->renderTile (tile.image);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Render the tiles of all visible deferred views at once, then composite them
+ * @param painter
+ */
+void TraceCompositor::draw (QCPPainter *painter)
+{
+    if (!mEnabled || !ChannelView::isRasterPainter (painter))
+      {
+        return;
+      }
+
+    int count = 0;
+    for (int i = 0; i < mParentPlot->plottableCount(); i++)
+      {
+        ChannelView *view = qobject_cast<ChannelView*> (mParentPlot->plottable (i));
+        if (view == nullptr || !view->isDeferred() || !view->realVisibility())
+          {
+            continue;
+          }
+        if (mTiles.size() <= count)
+          {
+            mTiles.resize (count + 1);
+          }
+        mTiles[count++].view = view;
+      }
+    mTiles.resize (count);                                                                // Images of the first 'count' tiles are kept
+
+    /* The store and the axes are only read while the GUI thread waits here */
+    QtConcurrent::blockingMap (mTiles, render);
+
+    for (int i = 0; i < mTiles.size(); i++)
+      {
+        if (!mTiles[i].target.isEmpty())
+          {
+            painter->drawImage (mTiles[i].target.topLeft(), mTiles[i].image, QRect (QPoint (0, 0), mTiles[i].target.size()));
+          }
+      }
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef TRACECOMPOSITOR_HPP
+#define TRACECOMPOSITOR_HPP
+
+#include "qcustomplot/qcustomplot.h"
+#include "channelview.hpp"
+
+/**
+ * @brief Draws every deferred ChannelView from per channel tiles rendered in parallel
+ *
+ * Each visible channel rasterizes into its own transparent tile on the
+ * thread pool, then the tiles are composited in legend order, so a frame
+ * takes as long as its slowest channel instead of the sum of all of them.
+ * Lives on the layer of the views and only acts on raster painters; exports
+ * draw the views themselves.
+ */
+class TraceCompositor : public QCPLayerable
+{
+    Q_OBJECT
+
+public:
+    explicit TraceCompositor (QCustomPlot *plot);
+
+    void setEnabled (bool enabled);                                                       // Defers all present and future views
+    bool isEnabled() const { return mEnabled; }
+    void adopt (ChannelView *view) { if (mEnabled) view->setDeferred (true); }            // Call for every new view
+
+protected:
+    virtual void applyDefaultAntialiasingHint (QCPPainter *painter) const Q_DECL_OVERRIDE;
+    virtual QRect clipRect() const Q_DECL_OVERRIDE;
+    virtual void draw (QCPPainter *painter) Q_DECL_OVERRIDE;
+
+private:
+    struct Tile
+    {
+        ChannelView *view;
+        QImage image;
+        QRect target;
+    };
+
+    bool mEnabled;
+    QVector<Tile> mTiles;                                                                 // Images kept between frames
+
+    static void render (Tile &tile);
+};
+
+#endif // TRACECOMPOSITOR_HPP
@@ -0,0 +1,170 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "tracepresenter.hpp"
+
+/**
+ * @brief Constructor, the presenter goes to the plot's "main" layer
+ * @param plot
+ */
+TracePresenter::TracePresenter (QCustomPlot *plot) :
+    QCPLayerable (plot, "main"),
+    mEnabled (false)
+{
+    connect (&mRenderer, SIGNAL (frameReady()), this, SLOT (onFrameReady()));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Switch between pipelined frames and each view drawing itself
+ * @param enabled
+ */
+void TracePresenter::setEnabled (bool enabled)
+{
+    mEnabled = enabled;
+    for (int i = 0; i < mParentPlot->plottableCount(); i++)
+      {
+        ChannelView *view = qobject_cast<ChannelView*> (mParentPlot->plottable (i));
+        if (view != nullptr)
+          {
+            view->setDeferred (enabled);
+          }
+      }
+    /* A finished frame then only repaints its own layer */
+    layer()->setMode (enabled ? QCPLayer::lmBuffered : QCPLayer::lmLogical);
+    mSignature.clear();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Frames are blitted, no antialiasing involved
+ * @param painter
+ */
+void TracePresenter::applyDefaultAntialiasingHint (QCPPainter *painter) const
+{
+    applyAntialiasingHint (painter, false, QCP::aePlottables);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Frames are clipped to the axis rect, like the views
+ * @return
+ */
+QRect TracePresenter::clipRect() const
+{
+    return mParentPlot->axisRect()->rect();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Submit the current traces if they changed, then show the last finished frame
+ * @param painter
+ */
+void TracePresenter::draw (QCPPainter *painter)
+{
+    if (!mEnabled || !ChannelView::isRasterPainter (painter))
+      {
+        return;
+      }
+
+    TraceFrame frame;
+    QVector<double> signature;
+    QCPAxis *keyAxis = nullptr;
+    QCPAxis *valueAxis = nullptr;
+    for (int i = 0; i < mParentPlot->plottableCount(); i++)
+      {
+        ChannelView *view = qobject_cast<ChannelView*> (mParentPlot->plottable (i));
+        if (view == nullptr || !view->isDeferred() || !view->realVisibility())
+          {
+            continue;
+          }
+        keyAxis = view->keyAxis();
+        valueAxis = view->valueAxis();
+
+        TraceFrame::Trace trace;
+        trace.store = view->store();
+        trace.channel = view->channel();
+        trace.color = (view->selected() ? view->selectionDecorator()->pen() : view->pen()).color();
+        frame.traces.append (trace);
+        signature << trace.store->publishedVersion() << trace.channel << trace.color.rgba();
+      }
+    if (keyAxis == nullptr)
+      {
+        return;
+      }
+    frame.map = PixelMap (keyAxis, valueAxis);
+    frame.area = clipRect();
+
+    if (signature != mSignature || !(frame.map == mMap) || frame.area != mArea)
+      {
+        mRenderer.submit (frame);
+        mSignature = signature;
+        mMap = frame.map;
+        mArea = frame.area;
+      }
+    present (painter, frame.map);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Blit the last finished frame, moved and scaled from its axes to the current ones
+ * @param painter
+ * @param map Current axes
+ */
+void TracePresenter::present (QCPPainter *painter, const PixelMap &map)
+{
+    QImage image;
+    PixelMap drawn;
+    QRect area;
+    if (!mRenderer.latest (image, drawn, area) || drawn.xSpan == 0 || drawn.ySpan == 0)
+      {
+        return;
+      }
+    if (drawn == map && area == clipRect())
+      {
+        painter->drawImage (area.topLeft(), image);
+        return;
+      }
+
+    /* Plot coordinates of the frame's corners, then where they are now */
+    const double left = drawn.key (area.left());
+    const double right = drawn.key (area.left() + area.width());
+    const double top = drawn.value (area.top());
+    const double bottom = drawn.value (area.top() + area.height());
+    painter->drawImage (QRectF (QPointF (map.x (left), map.y (top)), QPointF (map.x (right), map.y (bottom))), image);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief A frame is done, redraw only the layer it is shown on
+ */
+void TracePresenter::onFrameReady()
+{
+    if (mEnabled)
+      {
+        layer()->replot();
+      }
+}
@@ -0,0 +1,74 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef TRACEPRESENTER_HPP
+#define TRACEPRESENTER_HPP
+
+#include "qcustomplot/qcustomplot.h"
+#include "channelview.hpp"
+#include "framerenderer.hpp"
+
+/**
+ * @brief Draws every deferred ChannelView from frames rendered on a FrameRenderer thread
+ *
+ * On each replot the visible views are captured into a TraceFrame (stores,
+ * axes, colors) and handed to the render thread if anything, including the
+ * stores' published snapshots, changed, then the last finished frame is blitted, stretched to the
+ * current axes if they moved since. The replot never waits for the
+ * traces; when a frame is done only the "main" layer is redrawn. Axes,
+ * grid and legend stay on the GUI thread. Only acts on raster painters,
+ * exports draw the views themselves.
+ */
+class TracePresenter : public QCPLayerable
+{
+    Q_OBJECT
+
+public:
+    explicit TracePresenter (QCustomPlot *plot);
+
+    void setEnabled (bool enabled);                                                       // Defers all present and future views
+    bool isEnabled() const { return mEnabled; }
+    void adopt (ChannelView *view) { if (mEnabled) view->setDeferred (true); }            // Call for every new view
+
+protected:
+    virtual void applyDefaultAntialiasingHint (QCPPainter *painter) const Q_DECL_OVERRIDE;
+    virtual QRect clipRect() const Q_DECL_OVERRIDE;
+    virtual void draw (QCPPainter *painter) Q_DECL_OVERRIDE;
+
+private slots:
+    void onFrameReady();
+
+private:
+    bool mEnabled;
+    FrameRenderer mRenderer;
+    PixelMap mMap;                                                                        // Of the last frame handed over
+    QRect mArea;
+    QVector<double> mSignature;                                                           // Store version, channel and color of each trace
+
+    void present (QCPPainter *painter, const PixelMap &map);
+};
+
+#endif // TRACEPRESENTER_HPP
@@ -0,0 +1,231 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "traceraster.hpp"
+#include <climits>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TRACERASTER_SSE2
+#endif
+
+/**
+ * @brief Write one scanline: 'color' where the row is inside the column's span, transparent elsewhere
+ * @param line
+ * @param top
+ * @param bottom
+ * @param count Columns
+ * @param row
+ * @param color Premultiplied
+ */
+static void fillScanline (QRgb *line, const int *top, const int *bottom, int count, int row, QRgb color)
+{
+    int i = 0;
+#ifdef TRACERASTER_SSE2
+    const __m128i vRow = _mm_set1_epi32 (row);
+    const __m128i vColor = _mm_set1_epi32 (int (color));
+    for (; i + 4 <= count; i += 4)
+      {
+        const __m128i t = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (top + i));
+        const __m128i b = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (bottom + i));
+        const __m128i outside = _mm_or_si128 (_mm_cmpgt_epi32 (t, vRow), _mm_cmpgt_epi32 (vRow, b));
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (line + i), _mm_andnot_si128 (outside, vColor));
+      }
+#endif
+    for (; i < count; i++)
+      {
+        line[i] = (top[i] <= row && row <= bottom[i]) ? color : 0;
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Constructor
+ */
+TraceRaster::TraceRaster() :
+  mFirst (0),
+  mLast (-1),
+  mMinTop (0),
+  mMaxBottom (-1)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Start a new trace
+ * @param area Pixels that may be drawn, usually the axis rect
+ */
+void TraceRaster::begin (const QRect &area)
+{
+    mArea = area;
+    mTop.fill (INT_MAX, area.width());
+    mBottom.fill (INT_MIN, area.width());
+    mFirst = area.width();
+    mLast = -1;
+    mMinTop = area.height();
+    mMaxBottom = -1;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Extend a column's span to cover [y0, y1] (either order, relative to the area)
+ */
+void TraceRaster::addSpan (int column, double y0, double y1)
+{
+    if (column < 0 || column >= mArea.width())
+      {
+        return;
+      }
+    int top = qRound (qMin (y0, y1));
+    int bottom = qRound (qMax (y0, y1));
+    if (bottom < 0 || top >= mArea.height())
+      {
+        return;
+      }
+    top = qMax (top, 0);
+    bottom = qMin (bottom, mArea.height() - 1);
+
+    mTop[column] = qMin (mTop[column], top);
+    mBottom[column] = qMax (mBottom[column], bottom);
+    mFirst = qMin (mFirst, column);
+    mLast = qMax (mLast, column);
+    mMinTop = qMin (mMinTop, top);
+    mMaxBottom = qMax (mMaxBottom, bottom);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Add the spans lit by a polyline
+ *
+ * A segment inside one column is a span; a longer one is cut at the column
+ * borders, each piece giving the span of its column. As with Bresenham,
+ * a flat piece lights one pixel and a steep one leaves its last pixel to
+ * the next column.
+ * @param points
+ * @param count
+ */
+void TraceRaster::addPolyline (const QPointF *points, int count)
+{
+    if (count == 1)
+      {
+        addSpan (int (std::floor (points[0].x() - mArea.left())), points[0].y() - mArea.top(), points[0].y() - mArea.top());
+        return;
+      }
+
+    for (int i = 1; i < count; i++)
+      {
+        const double x0 = points[i - 1].x() - mArea.left();
+        const double y0 = points[i - 1].y() - mArea.top();
+        const double x1 = points[i].x() - mArea.left();
+        const double y1 = points[i].y() - mArea.top();
+        const int c0 = int (std::floor (qBound (-1.0, x0, double (mArea.width()))));
+        const int c1 = int (std::floor (qBound (-1.0, x1, double (mArea.width()))));
+        if (c0 == c1)
+          {
+            addSpan (c0, y0, y1);
+            continue;
+          }
+
+        const double slope = (y1 - y0) / (x1 - x0);
+        for (int c = qMax (c0, 0); c <= c1 && c < mArea.width(); c++)
+          {
+            const double left = qMax (x0, double (c));
+            const double right = qMin (x1, double (c + 1));
+            double ya = y0 + (left - x0) * slope;
+            double yb = y0 + (right - x0) * slope;
+            if (qAbs (yb - ya) < 1)
+              {
+                ya = yb = (ya + yb) / 2;
+              }
+            else if (right < x1)
+              {
+                yb += yb > ya ? -1 : 1;
+              }
+            addSpan (c, ya, yb);
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Fill the spans and blit them, strip by strip
+ * @param painter Must map pixels 1:1 (translation only)
+ * @param color
+ */
+void TraceRaster::draw (QPainter *painter, const QColor &color)
+{
+    if (mLast < mFirst || mMaxBottom < mMinTop)
+      {
+        return;
+      }
+    const int columns = mLast - mFirst + 1;
+    if (mStrip.width() < columns)
+      {
+        mStrip = QImage (mArea.width(), TRACE_RASTER_ROWS, QImage::Format_ARGB32_Premultiplied);
+      }
+    const QRgb pixel = qPremultiply (color.rgba());
+    const int *top = mTop.constData() + mFirst;
+    const int *bottom = mBottom.constData() + mFirst;
+
+    for (int row = mMinTop; row <= mMaxBottom; row += TRACE_RASTER_ROWS)
+      {
+        const int rows = qMin (TRACE_RASTER_ROWS, mMaxBottom - row + 1);
+        for (int r = 0; r < rows; r++)
+          {
+            fillScanline (reinterpret_cast<QRgb*> (mStrip.scanLine (r)), top, bottom, columns, row + r, pixel);
+          }
+        painter->drawImage (QPoint (mArea.left() + mFirst, mArea.top() + row), mStrip, QRect (0, 0, columns, rows));
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Fill the spans into a tile covering the band of the trace
+ * @param tile Reallocated to the area size when too small, only its top left part is written
+ * @param color
+ * @return Pixels of the painter the written part of the tile belongs to, empty if nothing was drawn
+ */
+QRect TraceRaster::fill (QImage &tile, const QColor &color)
+{
+    if (mLast < mFirst || mMaxBottom < mMinTop)
+      {
+        return QRect();
+      }
+    const int columns = mLast - mFirst + 1;
+    const int rows = mMaxBottom - mMinTop + 1;
+    if (tile.width() < columns || tile.height() < rows)
+      {
+        tile = QImage (mArea.size(), QImage::Format_ARGB32_Premultiplied);
+      }
+    const QRgb pixel = qPremultiply (color.rgba());
+
+    for (int r = 0; r < rows; r++)
+      {
+        fillScanline (reinterpret_cast<QRgb*> (tile.scanLine (r)), mTop.constData() + mFirst, mBottom.constData() + mFirst, columns, mMinTop + r, pixel);
+      }
+    return QRect (mArea.left() + mFirst, mArea.top() + mMinTop, columns, rows);
+}
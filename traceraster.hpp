@@ -0,0 +1,68 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef TRACERASTER_HPP
+#define TRACERASTER_HPP
+
+#include <QVector>
+#include <QImage>
+#include <QPainter>
+
+#define TRACE_RASTER_ROWS    64                                                           // Scanlines filled per blit
+
+/**
+ * @brief Draws a 1 pixel trace as one vertical span per pixel column
+ *
+ * A trace reduced to first/min/max/last per pixel column lights, in each
+ * column, one run of pixels: the samples' extremes plus the segment joining
+ * it to the previous column. Spans are collected from the polyline, then
+ * the band of rows they cover is filled scanline by scanline (four columns
+ * per step with SSE2) into a small strip image that is blitted with the
+ * painter, TRACE_RASTER_ROWS rows at a time. fill() renders the whole band
+ * into a tile instead, which needs no painter and may run on any thread.
+ */
+class TraceRaster
+{
+public:
+    TraceRaster();
+
+    void begin (const QRect &area);                                                       // Pixel area, forgets the previous trace
+    void addPolyline (const QPointF *points, int count);                                  // Points in pixels, x not decreasing
+    void draw (QPainter *painter, const QColor &color);
+    QRect fill (QImage &tile, const QColor &color);                                       // Whole trace into 'tile' at (0, 0), returns where it goes
+
+private:
+    QRect mArea;
+    QVector<int> mTop;                                                                    // Span of each column, relative to the area;
+    QVector<int> mBottom;                                                                 // top > bottom when the column is empty
+    int mFirst, mLast;                                                                    // Columns with a span
+    int mMinTop, mMaxBottom;                                                              // Rows with a span
+    QImage mStrip;
+
+    void addSpan (int column, double y0, double y1);
+};
+
+#endif // TRACERASTER_HPP
@@ -0,0 +1,199 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "tracereducer.hpp"
+#include <QtMath>
+#include <QtNumeric>
+
+/**
+ * @brief Samples falling in the same pixel column
+ */
+struct PixelColumn
+{
+    int column;
+    int count;
+    double x;                                                                             // Pixel of the first sample
+    double first, last, minimum, maximum;
+};
+
+/**
+ * @brief Append the reduced points of a pixel column to the polyline
+ * @param lines
+ * @param pixel
+ * @param map
+ */
+static void closeColumn (QVector<QPointF> &lines, PixelColumn &pixel, const PixelMap &map)
+{
+    if (pixel.count == 0)
+      {
+        return;
+      }
+    if (pixel.count == 1)
+      {
+        lines.append (QPointF (pixel.x, map.y (pixel.first)));
+      }
+    else
+      {
+        lines.append (QPointF (pixel.column, map.y (pixel.first)));
+        lines.append (QPointF (pixel.column, map.y (pixel.minimum)));
+        lines.append (QPointF (pixel.column, map.y (pixel.maximum)));
+        lines.append (QPointF (pixel.column, map.y (pixel.last)));
+      }
+    pixel.count = 0;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Add one sample, closing the previous pixel column if it moved on
+ */
+static void addSample (QVector<QPointF> &lines, PixelColumn &pixel, const PixelMap &map, double x, double value)
+{
+    const int column = int (qFloor (x));
+    if (pixel.count > 0 && column != pixel.column)
+      {
+        closeColumn (lines, pixel, map);
+      }
+    if (pixel.count == 0)
+      {
+        pixel.column = column;
+        pixel.x = x;
+        pixel.first = pixel.minimum = pixel.maximum = value;
+      }
+    else
+      {
+        pixel.minimum = qMin (pixel.minimum, value);
+        pixel.maximum = qMax (pixel.maximum, value);
+      }
+    pixel.last = value;
+    pixel.count++;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Snapshot of two linear axes
+ * @param keyAxis Horizontal axis
+ * @param valueAxis
+ */
+PixelMap::PixelMap (QCPAxis *keyAxis, QCPAxis *valueAxis) :
+  keyLower (keyAxis->range().lower),
+  keyUpper (keyAxis->range().upper),
+  x0 (keyAxis->coordToPixel (keyLower)),
+  xSpan (keyAxis->coordToPixel (keyUpper) - x0),
+  valueLower (valueAxis->range().lower),
+  valueUpper (valueAxis->range().upper),
+  y0 (valueAxis->coordToPixel (valueLower)),
+  ySpan (valueAxis->coordToPixel (valueUpper) - y0)
+{
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Reduce the samples inside the key range plus one on each side to a polyline
+ *
+ * Samples are reduced to first/min/max/last per pixel column, blocks that
+ * fall inside a single pixel column only use their stored extremes.
+ * @param blocks Store blocks, live or a snapshot
+ * @param channel
+ * @param map
+ * @param lines Gets the polyline in pixels
+ * @param scratch Block samples widened to double
+ */
+void TraceReducer::reduce (const QVector<StoreBlock> &blocks, int channel, const PixelMap &map, QVector<QPointF> &lines, QVector<double> &scratch)
+{
+    lines.resize (0);
+
+    PixelColumn pixel;
+    pixel.count = 0;
+    bool before = false;                                                                  // Last sample left of the range, still to draw
+    double beforeKey = 0, beforeValue = 0;
+    bool done = false;
+
+    for (int b = qMax (0, ChannelStore::findBlock (blocks, map.keyLower) - 1); b < blocks.size() && !done; b++)
+      {
+        const StoreBlock &block = blocks[b];
+        const StoreColumn &column = block.values[channel];
+        if (column.isEmpty())
+          {
+            continue;
+          }
+        const int frames = block.frames;
+
+        /* Whole block inside one pixel column: first, extremes and last are enough */
+        if (block.firstKey >= map.keyLower && block.lastKey() <= map.keyUpper &&
+            qFloor (map.x (block.firstKey)) == qFloor (map.x (block.lastKey())))
+          {
+            if (qIsNaN (block.minimum[channel]))
+              {
+                continue;
+              }
+            if (before)
+              {
+                lines.append (QPointF (map.x (beforeKey), map.y (beforeValue)));
+                before = false;
+              }
+            addSample (lines, pixel, map, map.x (block.firstKey), block.firstValue[channel]);
+            pixel.minimum = qMin (pixel.minimum, block.minimum[channel]);
+            pixel.maximum = qMax (pixel.maximum, block.maximum[channel]);
+            pixel.count++;
+            pixel.last = block.lastValue[channel];
+            continue;
+          }
+
+        scratch.resize (frames);
+        column.read (0, frames, scratch.data());
+        const double *values = scratch.constData();
+        for (int f = 0; f < frames; f++)
+          {
+            const double value = values[f];
+            if (qIsNaN (value))
+              {
+                continue;
+              }
+            const double key = block.key (f);
+            if (key < map.keyLower)
+              {
+                before = true;
+                beforeKey = key;
+                beforeValue = value;
+                continue;
+              }
+            if (before)
+              {
+                lines.append (QPointF (map.x (beforeKey), map.y (beforeValue)));
+                before = false;
+              }
+            if (key > map.keyUpper)
+              {
+                closeColumn (lines, pixel, map);
+                lines.append (QPointF (map.x (key), map.y (value)));
+                done = true;
+                break;
+              }
+            addSample (lines, pixel, map, map.x (key), value);
+          }
+      }
+    closeColumn (lines, pixel, map);
+}
@@ -0,0 +1,74 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef TRACEREDUCER_HPP
+#define TRACEREDUCER_HPP
+
+#include <QVector>
+#include <QPointF>
+#include "qcustomplot/qcustomplot.h"
+#include "channelstore.hpp"
+
+/**
+ * @brief Plot coordinates to pixels for two linear axes, copied by value
+ *
+ * Unlike the axes themselves it can be handed to another thread.
+ */
+struct PixelMap
+{
+    PixelMap() : keyLower (0), keyUpper (0), x0 (0), xSpan (0), valueLower (0), valueUpper (0), y0 (0), ySpan (0) {}
+    PixelMap (QCPAxis *keyAxis, QCPAxis *valueAxis);
+
+    /* Same operations as QCPAxis::coordToPixel(), so samples land in the same columns */
+    double x (double key) const { return x0 + (key - keyLower) / (keyUpper - keyLower) * xSpan; }
+    double y (double value) const { return y0 + (value - valueLower) / (valueUpper - valueLower) * ySpan; }
+    double key (double x) const { return keyLower + (x - x0) / xSpan * (keyUpper - keyLower); }
+    double value (double y) const { return valueLower + (y - y0) / ySpan * (valueUpper - valueLower); }
+    bool operator== (const PixelMap &other) const
+    {
+        return keyLower == other.keyLower && keyUpper == other.keyUpper && x0 == other.x0 && xSpan == other.xSpan &&
+               valueLower == other.valueLower && valueUpper == other.valueUpper && y0 == other.y0 && ySpan == other.ySpan;
+    }
+
+    double keyLower, keyUpper;
+    double x0, xSpan;                                                                     // Pixels of keyLower and from there to keyUpper
+    double valueLower, valueUpper;
+    double y0, ySpan;                                                                     // Negative when the axis points up
+};
+
+/**
+ * @brief Reduces a channel to a pixel polyline, first/min/max/last per pixel column
+ *
+ * Only reads the blocks it is given, so it runs on a snapshot of the
+ * store just as well as on the live one.
+ */
+class TraceReducer
+{
+public:
+    static void reduce (const QVector<StoreBlock> &blocks, int channel, const PixelMap &map, QVector<QPointF> &lines, QVector<double> &scratch);
+};
+
+#endif // TRACEREDUCER_HPP
@@ -0,0 +1,205 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "waterfallmap.hpp"
+
+/**
+ * @brief Constructor
+ * @param keyAxis Time axis (must be horizontal)
+ * @param valueAxis Frequency axis
+ */
+WaterfallMap::WaterfallMap (QCPAxis *keyAxis, QCPAxis *valueAxis) :
+  QCPColorMap (keyAxis, valueAxis),
+  mHead (0),
+  mPending (0),
+  mAppended (0)
+{
+    setInterpolate (false);
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Set number of columns kept and cells per column; clears the history
+ * @param columns
+ * @param rows
+ */
+void WaterfallMap::setHistory (int columns, int rows)
+{
+    mMapData->setSize (qMax (columns, 1), qMax (rows, 1));
+    clearHistory();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Forget all columns; the ring is filled with the lower data range
+ */
+void WaterfallMap::clearHistory()
+{
+    const int columns = mMapData->keySize();
+
+    mMapData->fill (mDataRange.lower);
+    mMapData->setKeyRange (QCPRange (-columns, -1));
+    mHead = columns - 1;
+    mPending = 0;
+    mAppended = 0;
+    mMapImageInvalidated = true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Overwrite the oldest column with new data and advance the origin
+ * @param column valueSize() values, from the lowest to the highest value cell
+ */
+void WaterfallMap::appendColumn (const double *column)
+{
+    const int columns = mMapData->keySize();
+    const int rows = mMapData->valueSize();
+
+    mHead = (mHead + 1) % columns;
+    for (int v = 0; v < rows; v++)
+      {
+        mMapData->setCell (mHead, v, column[v]);
+      }
+
+    mAppended++;
+    mPending = qMin (mPending + 1, columns);
+    mMapData->setKeyRange (QCPRange (mAppended - columns, mAppended - 1));
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Colorize one physical column into the cached ring image
+ * @param physical
+ */
+void WaterfallMap::rasterizeColumn (int physical)
+{
+    const int rows = mMapData->valueSize();
+
+    mColumn.resize (rows);
+    mPixels.resize (rows);
+    for (int v = 0; v < rows; v++)
+      {
+        mColumn[v] = mMapData->cell (physical, v);
+      }
+
+    mGradient.colorize (mColumn.constData(), mDataRange, mPixels.data(), rows, 1, mDataScaleType == QCPAxis::stLogarithmic);
+
+    /* QImage counts scanlines from top, cells count from bottom */
+    for (int v = 0; v < rows; v++)
+      {
+        reinterpret_cast<QRgb*> (mMapImage.scanLine (rows - 1 - v))[physical] = mPixels[v];
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Full rebuild of the ring image
+ *
+ * Only needed when the size, gradient or data range changed; plain appends
+ * are handled column by column in draw().
+ */
+void WaterfallMap::updateMapImage()
+{
+    if (mMapData->isEmpty())
+      {
+        return;
+      }
+
+    const int columns = mMapData->keySize();
+    const int rows = mMapData->valueSize();
+
+    if (mMapImage.width() != columns || mMapImage.height() != rows)
+      {
+        mMapImage = QImage (QSize (columns, rows), QImage::Format_ARGB32_Premultiplied);
+      }
+
+    for (int c = 0; c < columns; c++)
+      {
+        rasterizeColumn (c);
+      }
+
+    mPending = 0;
+    mMapImageInvalidated = false;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Rasterize pending columns and blit the ring in time order
+ * @param painter
+ */
+void WaterfallMap::draw (QCPPainter *painter)
+{
+    if (mMapData->isEmpty() || !mKeyAxis || !mValueAxis)
+      {
+        return;
+      }
+    if (mKeyAxis.data()->orientation() != Qt::Horizontal)
+      {
+        qDebug() << Q_FUNC_INFO << "vertical key axis is not supported";
+        return;
+      }
+    applyDefaultAntialiasingHint (painter);
+
+    const int columns = mMapData->keySize();
+    const int rows = mMapData->valueSize();
+
+    if (mMapImageInvalidated || mMapImage.width() != columns || mMapImage.height() != rows)
+      {
+        updateMapImage();
+      }
+    else
+      {
+        for (; mPending > 0; mPending--)
+          {
+            rasterizeColumn ((mHead - mPending + 1 + columns) % columns);
+          }
+      }
+
+    /* Cells are centered on their coordinates, as in QCPColorMap */
+    const QCPRange keys = mMapData->keyRange();
+    const QCPRange values = mMapData->valueRange();
+    const double halfRow = rows > 1 ? 0.5 * (values.upper - values.lower) / (rows - 1) : 0.5;
+    const double top = values.upper + halfRow;
+    const double bottom = values.lower - halfRow;
+
+    /* Physical [oldest, columns) holds the older part, [0, oldest) the newer */
+    const int oldest = (mHead + 1) % columns;
+    const int olderCount = columns - oldest;
+    const double split = keys.lower + olderCount - 0.5;
+
+    const bool smoothBackup = painter->renderHints().testFlag (QPainter::SmoothPixmapTransform);
+    painter->setRenderHint (QPainter::SmoothPixmapTransform, mInterpolate);
+
+    QRectF olderRect (coordsToPixels (keys.lower - 0.5, top), coordsToPixels (split, bottom));
+    painter->drawImage (olderRect.normalized(), mMapImage, QRectF (oldest, 0, olderCount, rows));
+    if (oldest > 0)
+      {
+        QRectF newerRect (coordsToPixels (split, top), coordsToPixels (keys.upper + 0.5, bottom));
+        painter->drawImage (newerRect.normalized(), mMapImage, QRectF (0, 0, oldest, rows));
+      }
+
+    painter->setRenderHint (QPainter::SmoothPixmapTransform, smoothBackup);
+}
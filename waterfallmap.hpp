@@ -0,0 +1,69 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef WATERFALLMAP_HPP
+#define WATERFALLMAP_HPP
+
+#include "qcustomplot/qcustomplot.h"
+
+/**
+ * @brief Scrolling color map for spectrograms
+ *
+ * The underlying QCPColorMapData is used as a circular buffer of columns: a
+ * new column overwrites the oldest one and only the origin moves, so no cell
+ * is ever copied. The cached map image is circular too; appending a column
+ * only rasterizes that column, and drawing blits the two halves of the ring
+ * in time order. Only horizontal key axes are supported.
+ */
+class WaterfallMap : public QCPColorMap
+{
+    Q_OBJECT
+
+public:
+    WaterfallMap (QCPAxis *keyAxis, QCPAxis *valueAxis);
+
+    void setHistory (int columns, int rows);                                              // Resize (and clear) the ring
+    void appendColumn (const double *column);                                             // 'rows' values, lowest value first
+    void clearHistory();
+
+    int historyColumns() const { return mMapData->keySize(); }
+    qint64 appendedColumns() const { return mAppended; }
+
+protected:
+    virtual void updateMapImage() Q_DECL_OVERRIDE;
+    virtual void draw (QCPPainter *painter) Q_DECL_OVERRIDE;
+
+private:
+    int mHead;                                                                            // Physical column of the newest data
+    int mPending;                                                                         // Columns not rasterized yet
+    qint64 mAppended;                                                                     // Total columns since last clear
+    QVector<double> mColumn;
+    QVector<QRgb> mPixels;
+
+    void rasterizeColumn (int physical);
+};
+
+#endif // WATERFALLMAP_HPP
@@ -0,0 +1,183 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#include "waterfallwindow.hpp"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+
+/**
+ * @brief Constructor
+ * @param parent
+ */
+WaterfallWindow::WaterfallWindow (QWidget *parent) :
+  QDialog (parent),
+  ringPos (0),
+  received (0),
+  sinceFrame (0),
+  channelIndex (0),
+  dirty (false)
+{
+    comboSize = new QComboBox (this);
+    for (int size = 128; size <= 8192; size *= 2)
+      {
+        comboSize->addItem (QString::number (size), size);
+      }
+    comboSize->setCurrentIndex (comboSize->findData (512));
+
+    QHBoxLayout *controls = new QHBoxLayout;
+    controls->addWidget (new QLabel ("FFT size", this));
+    controls->addWidget (comboSize);
+    controls->addStretch();
+
+    plot = new QCustomPlot (this);
+    plot->setMinimumSize (640, 320);
+    plot->setBackground (QColor (48, 47, 47, 255));
+    plot->setNotAntialiasedElements (QCP::aeAll);
+    plot->xAxis->setLabel ("FFT frame");
+    plot->yAxis->setLabel ("Frequency (cycles/sample)");
+    foreach (QCPAxis *axis, plot->axisRect()->axes())
+      {
+        axis->setBasePen (QPen (QColor (170, 170, 170, 255)));
+        axis->setTickPen (QPen (QColor (170, 170, 170, 255)));
+        axis->setSubTickPen (QPen (QColor (170, 170, 170, 255)));
+        axis->setTickLabelColor (QColor (170, 170, 170, 255));
+        axis->setLabelColor (QColor (170, 170, 170, 255));
+        axis->grid()->setVisible (false);
+      }
+
+    map = new WaterfallMap (plot->xAxis, plot->yAxis);
+    map->setGradient (QCPColorGradient::gpThermal);
+    map->setDataRange (QCPRange (-120, 0));
+
+    QCPColorScale *colorScale = new QCPColorScale (plot);
+    colorScale->setType (QCPAxis::atRight);
+    colorScale->axis()->setLabel ("dB");
+    colorScale->axis()->setLabelColor (QColor (170, 170, 170, 255));
+    colorScale->axis()->setTickLabelColor (QColor (170, 170, 170, 255));
+    plot->plotLayout()->addElement (0, 1, colorScale);
+    map->setColorScale (colorScale);
+
+    QVBoxLayout *layout = new QVBoxLayout (this);
+    layout->addLayout (controls);
+    layout->addWidget (plot);
+
+    connect (comboSize, SIGNAL (currentIndexChanged (int)), this, SLOT (onFftSizeChanged (int)));
+    onFftSizeChanged (comboSize->currentIndex());
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Select the channel to analyze; history is cleared
+ * @param channel
+ * @param name
+ */
+void WaterfallWindow::setChannel (int channel, const QString &name)
+{
+    channelIndex = channel;
+    setWindowTitle ("Spectrogram - " + name);
+    clear();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief FFT size combo changed; rebuild the transform and the map
+ * @param index
+ */
+void WaterfallWindow::onFftSizeChanged (int index)
+{
+    spectrum.setSize (comboSize->itemData (index).toInt());
+    ring.fill (0, spectrum.size());
+    frame.resize (spectrum.size());
+    column.resize (spectrum.bins());
+
+    map->setHistory (WATERFALL_HISTORY, spectrum.bins());
+    map->data()->setValueRange (QCPRange (0, 0.5));
+    plot->yAxis->setRange (0, 0.5);
+    clear();
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Drop all samples and columns
+ */
+void WaterfallWindow::clear()
+{
+    ring.fill (0);
+    ringPos = 0;
+    received = 0;
+    sinceFrame = 0;
+    map->clearHistory();
+    dirty = true;
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Push new samples; computes a column each half FFT frame
+ * @param samples
+ * @param count
+ */
+void WaterfallWindow::addSamples (const double *samples, int count)
+{
+    const int n = spectrum.size();
+    const int hop = n / 2;
+
+    for (int i = 0; i < count; i++)
+      {
+        ring[ringPos] = qIsNaN (samples[i]) ? 0 : samples[i];
+        ringPos = (ringPos + 1) % n;
+        received++;
+
+        if (++sinceFrame >= hop && received >= n)
+          {
+            for (int k = 0; k < n; k++)
+              {
+                frame[k] = ring[(ringPos + k) % n];
+              }
+            spectrum.magnitudes (frame.constData(), column.data());
+            map->appendColumn (column.constData());
+            sinceFrame = 0;
+            dirty = true;
+          }
+      }
+}
+/** ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Scroll to the newest column and replot, only if something changed
+ */
+void WaterfallWindow::refresh()
+{
+    if (!dirty || !isVisible())
+      {
+        return;
+      }
+
+    const QCPRange keys = map->data()->keyRange();
+    plot->xAxis->setRange (keys.lower - 0.5, keys.upper + 0.5);
+    plot->replot();
+    dirty = false;
+}
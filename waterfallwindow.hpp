@@ -0,0 +1,78 @@
+/***************************************************************************
+**  This file is part of Serial Port Plotter                              **
+**                                                                        **
+**                                                                        **
+**  Serial Port Plotter is a program for plotting integer data from       **
+**  serial port using Qt and QCustomPlot                                  **
+**                                                                        **
+**  This program is free software: you can redistribute it and/or modify  **
+**  it under the terms of the GNU General Public License as published by  **
+**  the Free Software Foundation, either version 3 of the License, or     **
+**  (at your option) any later version.                                   **
+**                                                                        **
+**  This program is distributed in the hope that it will be useful,       **
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of        **
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         **
+**  GNU General Public License for more details.                          **
+**                                                                        **
+**  You should have received a copy of the GNU General Public License     **
+**  along with this program.  If not, see http://www.gnu.org/licenses/.   **
+**                                                                        **
+****************************************************************************
+**           Author: Borislav                                             **
+**           Contact: b.kereziev@gmail.com                                **
+**           Date: 29.12.14                                               **
+****************************************************************************/
+
+#ifndef WATERFALLWINDOW_HPP
+#define WATERFALLWINDOW_HPP
+
+#include <QDialog>
+#include <QComboBox>
+#include "qcustomplot/qcustomplot.h"
+#include "spectrum.hpp"
+#include "waterfallmap.hpp"
+
+#define WATERFALL_HISTORY    2048                                                         // Columns (FFT frames) kept on screen
+
+/**
+ * @brief Spectrogram of one channel
+ *
+ * Samples are pushed in as they arrive, a new FFT frame is computed every
+ * half frame (50% overlap) and appended as one column of a WaterfallMap.
+ */
+class WaterfallWindow : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit WaterfallWindow (QWidget *parent = nullptr);
+
+    void setChannel (int channel, const QString &name);
+    int channel() const { return channelIndex; }
+    void addSamples (const double *samples, int count);                                   // Feed new samples of channel()
+    void clear();
+
+public slots:
+    void refresh();                                                                       // Replot if new columns arrived
+
+private slots:
+    void onFftSizeChanged (int index);
+
+private:
+    QCustomPlot *plot;
+    WaterfallMap *map;
+    QComboBox *comboSize;
+    Spectrum spectrum;
+
+    QVector<double> ring;                                                                 // Last spectrum.size() samples
+    QVector<double> frame;                                                                // Ring unrolled, oldest first
+    QVector<double> column;                                                               // One spectrum
+    int ringPos;
+    qint64 received;
+    int sinceFrame;
+    int channelIndex;
+    bool dirty;
+};
+
+#endif // WATERFALLWINDOW_HPP